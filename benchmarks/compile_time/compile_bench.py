@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+#=============================================================================
+# Copyright (c) 2020, NVIDIA CORPORATION.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#=============================================================================
+"""Measures the build-time cost of using nvtx3.hpp.
+
+Generates a set of synthetic translation units, each containing many uses of
+`thread_range`, `event_attributes{...}`, `mark` and `NVTX3_FUNC_RANGE` with
+the attribute arguments in varying orders, then compiles every unit under
+each requested header configuration and reports:
+
+  - total and per-TU compile time (wall clock of the compiler process)
+  - total object file size
+  - number of defined symbols, and how many of those belong to `nvtx3::`
+
+Generation is deterministic for a given --seed so runs are comparable.
+"""
+
+import argparse
+import concurrent.futures
+import os
+import random
+import subprocess
+import sys
+import time
+
+# Attribute argument spellings used in generated call sites. Every site picks
+# a random subset in a random order, exercising many `event_attributes`
+# constructor instantiations.
+ATTRIBUTES = [
+    'nvtx3::rgb{{{r}, {g}, {b}}}',
+    'nvtx3::payload{{{i}}}',
+    'nvtx3::category{{{c}}}',
+    '"message {i}"',
+]
+
+DEFAULT_CONFIGS = [
+    'c++11-O0:-std=c++11 -O0',
+    'c++14-O0:-std=c++14 -O0',
+    'c++14-O2:-std=c++14 -O2',
+    'c++17-O2:-std=c++17 -O2',
+]
+
+
+def make_arguments(rng, i):
+    count = rng.randint(1, len(ATTRIBUTES))
+    chosen = rng.sample(ATTRIBUTES, count)
+    return ', '.join(
+        a.format(r=rng.randint(0, 255), g=rng.randint(0, 255),
+                 b=rng.randint(0, 255), i=i, c=rng.randint(1, 16))
+        for a in chosen)
+
+
+def generate_tu(rng, index, sites):
+    lines = ['#include <nvtx3.hpp>', '',
+             'namespace tu_{} {{'.format(index), '',
+             'struct domain {',
+             '  static constexpr char const* name{{"tu_{}"}};'.format(index),
+             '};', '']
+    for s in range(sites):
+        kind = s % 4
+        lines.append('void site_{}() {{'.format(s))
+        if kind == 0:
+            lines.append('  nvtx3::thread_range r{{{}}};'.format(
+                make_arguments(rng, s)))
+        elif kind == 1:
+            lines.append('  nvtx3::domain_thread_range<domain> r{{{}}};'.format(
+                make_arguments(rng, s)))
+        elif kind == 2:
+            lines.append('  nvtx3::event_attributes attr{{{}}};'.format(
+                make_arguments(rng, s)))
+            lines.append('  nvtx3::mark<domain>(attr);')
+        else:
+            lines.append('  NVTX3_FUNC_RANGE_IN(domain);')
+        lines.append('}')
+        lines.append('')
+    lines.append('}}  // namespace tu_{}'.format(index))
+    lines.append('')
+    return '\n'.join(lines)
+
+
+def generate(output_dir, tus, sites, seed):
+    rng = random.Random(seed)
+    src_dir = os.path.join(output_dir, 'src')
+    os.makedirs(src_dir, exist_ok=True)
+    sources = []
+    for t in range(tus):
+        path = os.path.join(src_dir, 'tu_{}.cpp'.format(t))
+        content = generate_tu(rng, t, sites)
+        # Avoid touching unchanged files so reruns are not perturbed by the
+        # filesystem
+        if not os.path.exists(path) or open(path).read() != content:
+            with open(path, 'w') as f:
+                f.write(content)
+        sources.append(path)
+    return sources
+
+
+def compile_one(compiler, flags, includes, source, obj):
+    cmd = [compiler] + flags + ['-I' + i for i in includes] + \
+          ['-c', source, '-o', obj]
+    start = time.perf_counter()
+    subprocess.run(cmd, check=True)
+    return time.perf_counter() - start
+
+
+def count_symbols(obj):
+    out = subprocess.run(['nm', '-C', '--defined-only', obj], check=True,
+                         stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout.splitlines()
+    return len(out), sum(1 for l in out if 'nvtx3::' in l)
+
+
+def run_config(name, flags, compiler, includes, sources, output_dir, jobs):
+    obj_dir = os.path.join(output_dir, 'obj', name)
+    os.makedirs(obj_dir, exist_ok=True)
+    objs = [os.path.join(obj_dir, os.path.basename(s) + '.o') for s in sources]
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs) as pool:
+        times = list(pool.map(
+            lambda so: compile_one(compiler, flags, includes, *so),
+            zip(sources, objs)))
+    size = sum(os.path.getsize(o) for o in objs)
+    symbols, nvtx3_symbols = map(sum, zip(*(count_symbols(o) for o in objs)))
+    return {
+        'config': name,
+        'compile_s': sum(times),
+        'per_tu_ms': 1000.0 * sum(times) / len(times),
+        'max_tu_ms': 1000.0 * max(times),
+        'object_bytes': size,
+        'symbols': symbols,
+        'nvtx3_symbols': nvtx3_symbols,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--compiler', default=os.environ.get('CXX', 'c++'))
+    parser.add_argument('--include', action='append', default=[],
+                        help='Include directory, may be repeated. Must '
+                             'provide nvtx3.hpp and nvtx3/nvToolsExt.h')
+    parser.add_argument('--output-dir', default='compile_bench')
+    parser.add_argument('--tus', type=int, default=200,
+                        help='Number of generated translation units')
+    parser.add_argument('--sites', type=int, default=100,
+                        help='Number of annotated functions per unit')
+    parser.add_argument('--seed', type=int, default=42)
+    parser.add_argument('--jobs', type=int, default=os.cpu_count())
+    parser.add_argument('--config', action='append', default=[],
+                        help='NAME:FLAGS header configuration, may be '
+                             'repeated. Defaults to: ' +
+                             ', '.join(DEFAULT_CONFIGS))
+    parser.add_argument('--csv', help='Also write results to this file')
+    args = parser.parse_args()
+
+    sources = generate(args.output_dir, args.tus, args.sites, args.seed)
+
+    results = []
+    for config in args.config or DEFAULT_CONFIGS:
+        name, _, flags = config.partition(':')
+        results.append(run_config(name, flags.split(), args.compiler,
+                                  args.include, sources, args.output_dir,
+                                  args.jobs))
+
+    columns = ['config', 'compile_s', 'per_tu_ms', 'max_tu_ms',
+               'object_bytes', 'symbols', 'nvtx3_symbols']
+    print('{} TUs x {} sites'.format(args.tus, args.sites))
+    print(''.join('{:>16}'.format(c) for c in columns))
+    for r in results:
+        print(''.join('{:>16.2f}'.format(r[c]) if isinstance(r[c], float)
+                      else '{:>16}'.format(r[c]) for c in columns))
+
+    if args.csv:
+        with open(args.csv, 'w') as f:
+            f.write(','.join(columns) + '\n')
+            for r in results:
+                f.write(','.join(str(r[c]) for c in columns) + '\n')
+
+
+if __name__ == '__main__':
+    sys.exit(main())
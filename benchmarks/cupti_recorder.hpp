@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cupti.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+
+namespace bench {
+
+/**
+ * @brief A single event captured by the stand-in recorder.
+ *
+ */
+struct recorded_event {
+  uint64_t timestamp;  ///< Time the callback was invoked, in nanoseconds
+  CUpti_CallbackId cbid;  ///< The NVTX API that was invoked
+};
+
+/**
+ * @brief Returns the calling thread's event buffer.
+ *
+ * Each thread appends to its own buffer so that the recorder itself does not
+ * introduce any shared cache line between threads.
+ */
+inline std::vector<recorded_event>& thread_buffer() {
+  thread_local std::vector<recorded_event> buffer = [] {
+    std::vector<recorded_event> b;
+    b.reserve(1 << 20);
+    return b;
+  }();
+  return buffer;
+}
+
+/**
+ * @brief CUPTI callback recording every NVTX API invocation into the calling
+ * thread's buffer.
+ *
+ * The buffer is cleared instead of grown once it is full to bound memory use
+ * in long benchmark runs.
+ */
+inline void CUPTIAPI record_callback(void*, CUpti_CallbackDomain domain,
+                                     CUpti_CallbackId cbid, const void*) {
+  if (domain != CUPTI_CB_DOMAIN_NVTX) {
+    return;
+  }
+  auto& buffer = thread_buffer();
+  if (buffer.size() == buffer.capacity()) {
+    buffer.clear();
+  }
+  auto const now = std::chrono::steady_clock::now().time_since_epoch();
+  buffer.push_back(recorded_event{
+      static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()),
+      cbid});
+}
+
+/**
+ * @brief Injects CUPTI into NVTX and subscribes `record_callback` to all NVTX
+ * APIs.
+ *
+ * Must be invoked before the first NVTX call in the process, as NVTX only
+ * looks for an injection library once.
+ */
+inline void enable_recorder() {
+  // Get path to `libcupti.so` from the `CUPTI_PATH` definition specified as a
+  // compile argument
+  constexpr char const* cupti_path = TOSTRING(CUPTI_PATH);
+  setenv("NVTX_INJECTION64_PATH", cupti_path, 1);
+
+  CUpti_SubscriberHandle subscriber;
+  cuptiSubscribe(&subscriber, (CUpti_CallbackFunc)record_callback, nullptr);
+  cuptiEnableDomain(1, subscriber, CUPTI_CB_DOMAIN_NVTX);
+}
+
+}  // namespace bench
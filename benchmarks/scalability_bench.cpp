@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file scalability_bench.cpp
+ *
+ * @brief Measures how the cost of NVTX++ constructs scales with the number of
+ * threads concurrently using them.
+ *
+ * Every benchmark is run with 1 up to all hardware threads. The reported time
+ * is the per-operation cost seen by each thread and `items_per_second` is the
+ * total throughput across all threads. With perfect scaling the per-operation
+ * cost stays flat; any cache line shared between threads, in the wrappers or
+ * in the tool, shows up as a cliff in that curve.
+ *
+ * By default no tool is attached, measuring the overhead of the wrappers and
+ * the NVTX C layer alone. Pass `--with_recorder` to attach a stand-in recorder
+ * that appends every event to a per-thread buffer (see `cupti_recorder.hpp`).
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <nvtx3.hpp>
+
+#include "cupti_recorder.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace {
+
+struct bench_domain {
+  static constexpr char const* name{"scalability_bench"};
+};
+
+struct bench_message {
+  static constexpr char const* message{"scalability_bench message"};
+};
+
+using bench_registered_message = nvtx3::registered_message<bench_domain>;
+
+void BM_thread_range(benchmark::State& state) {
+  auto const& msg = bench_registered_message::get<bench_message>();
+  for (auto _ : state) {
+    nvtx3::domain_thread_range<bench_domain> r{msg};
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_nested_thread_range(benchmark::State& state) {
+  auto const& msg = bench_registered_message::get<bench_message>();
+  for (auto _ : state) {
+    nvtx3::domain_thread_range<bench_domain> outer{msg};
+    nvtx3::domain_thread_range<bench_domain> inner{msg, nvtx3::payload{42}};
+  }
+  state.SetItemsProcessed(2 * state.iterations());
+}
+
+void BM_mark(benchmark::State& state) {
+  nvtx3::event_attributes const attr{
+      bench_registered_message::get<bench_message>()};
+  for (auto _ : state) {
+    nvtx3::mark<bench_domain>(attr);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_registered_message_get(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(&bench_registered_message::get<bench_message>());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * @brief Registers a message never seen before on every iteration.
+ *
+ * Unlike `BM_registered_message_get`, which only measures the steady state of
+ * an already registered message, this exercises the tool's string registry
+ * the way first use at many distinct call sites does. Strings are made unique
+ * per thread by the address of the thread's own buffer, so the threads share
+ * nothing but the registry itself. The formatting cost is included.
+ */
+void BM_registered_message_first_use(benchmark::State& state) {
+  char buffer[64];
+  unsigned long long i{0};
+  for (auto _ : state) {
+    std::snprintf(buffer, sizeof(buffer), "scalability_bench %p/%llu",
+                  static_cast<void*>(buffer), i++);
+    bench_registered_message const msg{buffer};
+    benchmark::DoNotOptimize(msg.get_handle());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_domain_get(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(&nvtx3::domain::get<bench_domain>());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool with_recorder{false};
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--with_recorder") == 0) {
+      with_recorder = true;
+    }
+  }
+  if (with_recorder) {
+    bench::enable_recorder();
+  }
+
+  benchmark::Initialize(&argc, argv);
+
+  int const max_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  auto const prefix = with_recorder ? std::string{"recorder/"}
+                                    : std::string{"no_tool/"};
+
+  for (auto const& b : {std::make_pair("thread_range", &BM_thread_range),
+                        std::make_pair("nested_thread_range",
+                                       &BM_nested_thread_range),
+                        std::make_pair("mark", &BM_mark),
+                        std::make_pair("registered_message_get",
+                                       &BM_registered_message_get),
+                        std::make_pair("registered_message_first_use",
+                                       &BM_registered_message_first_use),
+                        std::make_pair("domain_get", &BM_domain_get)}) {
+    benchmark::RegisterBenchmark((prefix + b.first).c_str(), b.second)
+        ->DenseThreadRange(1, max_threads)
+        ->UseRealTime();
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+}
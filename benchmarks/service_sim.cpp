@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file service_sim.cpp
+ *
+ * @brief End-to-end overhead of NVTX++ annotations in a simulated server.
+ *
+ * Requests are issued by closed-loop clients and flow through a pipeline of
+ * stages. Each stage owns a thread pool fed by a queue, so every request hops
+ * threads once per stage. Within a stage a request is processed by a nest of
+ * annotated calls that split the stage's work between them.
+ *
+ * Annotation density mirrors an instrumented service: a process range for the
+ * lifetime of each request, a mark per queue hop, a thread range per stage and
+ * per nesting level, all using registered messages, categories and payloads.
+ *
+ * Modes:
+ *  - `off`       annotations are compiled out
+ *  - `no_tool`   annotations are on, no tool is attached
+ *  - `recorder`  annotations are on, the stand-in recorder is attached
+ *  - `all`       runs each of the above in a separate process (default), as
+ *                NVTX only looks for a tool once per process
+ *
+ * Usage:
+ * ```
+ * SERVICE_SIM [--mode=all|off|no_tool|recorder] [--stages=4] [--threads=4]
+ *             [--clients=16] [--requests=200000] [--depth=3] [--work_ns=2000]
+ * ```
+ */
+
+#include <nvtx3.hpp>
+
+#include "cupti_recorder.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct sim_domain {
+  static constexpr char const* name{"service_sim"};
+};
+
+struct options {
+  std::string mode{"all"};
+  int stages{4};
+  int threads{4};
+  int clients{16};
+  long requests{200000};
+  int depth{3};
+  long work_ns{2000};
+};
+
+/**
+ * @brief Busy-waits for `ns` nanoseconds, simulating CPU bound work.
+ *
+ */
+void spin_for(long ns) {
+  auto const end = clock_type::now() + std::chrono::nanoseconds{ns};
+  while (clock_type::now() < end) {
+  }
+}
+
+/**
+ * @brief A `domain_thread_range` that is only created when `Annotate` is
+ * true.
+ *
+ */
+template <bool Annotate>
+struct maybe_range {
+  template <typename... Args>
+  explicit maybe_range(Args const&...) noexcept {}
+};
+
+template <>
+struct maybe_range<true> {
+  template <typename... Args>
+  explicit maybe_range(Args const&... args) noexcept : r{args...} {}
+  nvtx3::domain_thread_range<sim_domain> r;
+};
+
+/**
+ * @brief A `domain_process_range` that is only created when `Annotate` is
+ * true.
+ *
+ */
+template <bool Annotate>
+struct maybe_process_range {
+  template <typename... Args>
+  explicit maybe_process_range(Args const&...) noexcept {}
+};
+
+template <>
+struct maybe_process_range<true> {
+  template <typename... Args>
+  explicit maybe_process_range(Args const&... args) noexcept : r{args...} {}
+  nvtx3::domain_process_range<sim_domain> r;
+};
+
+struct request {
+  uint64_t id;
+  clock_type::time_point submitted;
+  std::promise<void> done;
+};
+
+/**
+ * @brief Unbounded multi-producer, multi-consumer queue.
+ *
+ */
+class request_queue {
+ public:
+  void push(request* r) {
+    {
+      std::lock_guard<std::mutex> lock{mtx_};
+      q_.push_back(r);
+    }
+    cv_.notify_one();
+  }
+
+  /// Returns `nullptr` once the queue is closed and drained
+  request* pop() {
+    std::unique_lock<std::mutex> lock{mtx_};
+    cv_.wait(lock, [this] { return closed_ or not q_.empty(); });
+    if (q_.empty()) {
+      return nullptr;
+    }
+    auto r = q_.front();
+    q_.pop_front();
+    return r;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock{mtx_};
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+ private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<request*> q_;
+  bool closed_{false};
+};
+
+/**
+ * @brief Registered messages naming each stage and nesting level.
+ *
+ * Registered once up front, as an instrumented service would.
+ */
+struct messages {
+  explicit messages(options const& opt) {
+    for (int s = 0; s < opt.stages; ++s) {
+      stage.emplace_back(new nvtx3::registered_message<sim_domain>{
+          "stage " + std::to_string(s)});
+      level.emplace_back();
+      for (int d = 0; d < opt.depth; ++d) {
+        level.back().emplace_back(new nvtx3::registered_message<sim_domain>{
+            "stage " + std::to_string(s) + " level " + std::to_string(d)});
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<nvtx3::registered_message<sim_domain>>> stage;
+  std::vector<
+      std::vector<std::unique_ptr<nvtx3::registered_message<sim_domain>>>>
+      level;
+  nvtx3::registered_message<sim_domain> request_msg{"request"};
+  nvtx3::registered_message<sim_domain> enqueue_msg{"enqueue"};
+};
+
+template <bool Annotate>
+void process(options const& opt, messages const& msgs, request const& r,
+             int stage, int level) {
+  maybe_range<Annotate> range{*msgs.level[stage][level],
+                              nvtx3::category{static_cast<uint32_t>(stage)},
+                              nvtx3::payload{r.id}};
+  long const share = opt.work_ns / opt.depth;
+  spin_for(share);
+  if (level + 1 < opt.depth) {
+    process<Annotate>(opt, msgs, r, stage, level + 1);
+  }
+}
+
+template <bool Annotate>
+class pipeline {
+ public:
+  pipeline(options const& opt, messages const& msgs)
+      : opt_{opt}, msgs_{msgs}, queues_(opt.stages) {
+    for (int s = 0; s < opt.stages; ++s) {
+      for (int t = 0; t < opt.threads; ++t) {
+        workers_.emplace_back([this, s] { work(s); });
+      }
+    }
+  }
+
+  ~pipeline() {
+    for (auto& q : queues_) {
+      q.close();
+    }
+    for (auto& w : workers_) {
+      w.join();
+    }
+  }
+
+  void submit(request* r) { enqueue(0, r); }
+
+ private:
+  void enqueue(int stage, request* r) {
+    if (Annotate) {
+      nvtx3::mark<sim_domain>(nvtx3::event_attributes{
+          msgs_.enqueue_msg, nvtx3::payload{static_cast<int32_t>(stage)}});
+    }
+    queues_[stage].push(r);
+  }
+
+  void work(int stage) {
+    while (request* r = queues_[stage].pop()) {
+      {
+        maybe_range<Annotate> range{
+            *msgs_.stage[stage],
+            nvtx3::category{static_cast<uint32_t>(stage)},
+            nvtx3::payload{r->id}};
+        process<Annotate>(opt_, msgs_, *r, stage, 0);
+      }
+      if (stage + 1 < opt_.stages) {
+        enqueue(stage + 1, r);
+      } else {
+        r->done.set_value();
+      }
+    }
+  }
+
+  options const& opt_;
+  messages const& msgs_;
+  std::vector<request_queue> queues_;
+  std::vector<std::thread> workers_;
+};
+
+template <bool Annotate>
+void run(options const& opt) {
+  messages const msgs{opt};
+  std::vector<std::vector<double>> latencies(opt.clients);
+  std::atomic<long> next{0};
+
+  auto const start = clock_type::now();
+  {
+    pipeline<Annotate> p{opt, msgs};
+    std::vector<std::thread> clients;
+    for (int c = 0; c < opt.clients; ++c) {
+      clients.emplace_back([&, c] {
+        auto& lat = latencies[c];
+        for (long id = next++; id < opt.requests; id = next++) {
+          request r{static_cast<uint64_t>(id), clock_type::now(), {}};
+          auto f = r.done.get_future();
+          {
+            maybe_process_range<Annotate> life{msgs.request_msg,
+                                               nvtx3::payload{r.id}};
+            p.submit(&r);
+            f.wait();
+          }
+          lat.push_back(std::chrono::duration<double, std::micro>(
+                            clock_type::now() - r.submitted)
+                            .count());
+        }
+      });
+    }
+    for (auto& c : clients) {
+      c.join();
+    }
+  }
+  auto const elapsed =
+      std::chrono::duration<double>(clock_type::now() - start).count();
+
+  std::vector<double> all;
+  for (auto const& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto pct = [&all](double p) {
+    return all.empty() ? 0.0
+                       : all[std::min(all.size() - 1,
+                                      static_cast<std::size_t>(p * all.size()))];
+  };
+
+  std::printf("%-10s %14.0f %12.1f %12.1f %12.1f %12.1f\n", opt.mode.c_str(),
+              all.size() / elapsed, pct(0.5), pct(0.99), pct(0.999),
+              all.empty() ? 0.0 : all.back());
+}
+
+void print_header() {
+  std::printf("%-10s %14s %12s %12s %12s %12s\n", "mode", "requests/s",
+              "p50 (us)", "p99 (us)", "p99.9 (us)", "max (us)");
+}
+
+bool parse(char const* arg, char const* name, std::string& value) {
+  auto const n = std::strlen(name);
+  if (std::strncmp(arg, name, n) == 0 and arg[n] == '=') {
+    value = arg + n + 1;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  options opt;
+  std::string forwarded;
+  bool header{true};
+  for (int i = 1; i < argc; ++i) {
+    std::string v;
+    if (parse(argv[i], "--mode", v)) {
+      opt.mode = v;
+      continue;
+    } else if (std::strcmp(argv[i], "--no_header") == 0) {
+      header = false;
+      continue;
+    } else if (parse(argv[i], "--stages", v)) {
+      opt.stages = std::max(1, std::atoi(v.c_str()));
+    } else if (parse(argv[i], "--threads", v)) {
+      opt.threads = std::max(1, std::atoi(v.c_str()));
+    } else if (parse(argv[i], "--clients", v)) {
+      opt.clients = std::max(1, std::atoi(v.c_str()));
+    } else if (parse(argv[i], "--requests", v)) {
+      opt.requests = std::max(1L, std::atol(v.c_str()));
+    } else if (parse(argv[i], "--depth", v)) {
+      opt.depth = std::max(1, std::atoi(v.c_str()));
+    } else if (parse(argv[i], "--work_ns", v)) {
+      opt.work_ns = std::max(0L, std::atol(v.c_str()));
+    } else {
+      std::fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    forwarded += std::string{" "} + argv[i];
+  }
+
+  if (opt.mode == "all") {
+    std::printf("stages=%d threads/stage=%d clients=%d requests=%ld "
+                "depth=%d work_ns=%ld\n",
+                opt.stages, opt.threads, opt.clients, opt.requests, opt.depth,
+                opt.work_ns);
+    print_header();
+    std::fflush(stdout);
+    for (char const* mode : {"off", "no_tool", "recorder"}) {
+      auto const cmd =
+          std::string{argv[0]} + " --no_header --mode=" + mode + forwarded;
+      if (std::system(cmd.c_str()) != 0) {
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (header) {
+    print_header();
+  }
+  if (opt.mode == "off") {
+    run<false>(opt);
+  } else if (opt.mode == "no_tool") {
+    run<true>(opt);
+  } else if (opt.mode == "recorder") {
+    bench::enable_recorder();
+    run<true>(opt);
+  } else {
+    std::fprintf(stderr, "Unknown mode: %s\n", opt.mode.c_str());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -33,7 +33,16 @@
 
 #include <nvtx3/nvToolsExt.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 /**
  * @file nvtx3.hpp
@@ -205,6 +214,10 @@
  * }
  * \endcode
  *
+ * Programs running ranges on fibers (user-level threads) that migrate between
+ * OS threads should let their scheduler maintain a `nvtx3::fiber_context` per
+ * fiber to keep each OS thread's range stack consistent.
+ *
  * \subsection PROCESS_RANGE Process Range
  *
  * `nvtx3::domain_process_range` is identical to `nvtx3::domain_thread_range`
@@ -215,6 +228,16 @@
  * `nvtx3::domain_thread_range`s should be preferred unless one needs the
  * ability to begin and end a range on different threads.
  *
+ * `nvtx3::async`, declared in the separate header `nvtx3_async.hpp`, is a
+ * drop-in replacement for `std::async` that uses process ranges to show a
+ * task's lifetime and the delay before it starts executing.
+ *
+ * \subsection TIMED_RANGE Timed Range
+ *
+ * Wrapping either kind of range in a `nvtx3::timed_range` also measures its
+ * duration, which can be read with `elapsed()` or passed to a callback when
+ * the range ends, so application metrics can reuse the range's boundaries.
+ *
  * \section MARKS Marks
  *
  * `nvtx3::mark` allows annotating an instantaneous event in an application's
@@ -229,6 +252,14 @@
  * }
  * \endcode
  *
+ * `nvtx3::progress_point` is a named mark for throughput, visited once per
+ * unit of useful work such as a completed request.
+ *
+ * `nvtx3::slow_range` times a scope locally and emits a mark only when the
+ * scope runs longer than a threshold, giving always-on outlier visibility in
+ * hot code. Calling `nvtx3::calibrate_tick_clock()` once at startup lets it
+ * time scopes with the cheaper time stamp counter.
+ *
  * \section DOMAINS Domains
  *
  * Similar to C++ namespaces, Domains allow for scoping NVTX events. By default,
@@ -311,9 +342,18 @@
  *                      "message",
  *                      nvtx3::rgb{127, 255, 0}};
  *
- * // "First wins" with multiple arguments of the same type
- * event_attributes attr{ nvtx3::payload{42}, nvtx3::payload{7} }; // payload is
- * 42 \endcode
+ * // Passing more than one argument of the same kind is a compile error
+ * event_attributes attr{ nvtx3::payload{42}, nvtx3::payload{7} }; // error
+ * \endcode
+ *
+ * `nvtx3::scoped_defaults` sets a default category, color and payload for the
+ * thread ranges and marks of a domain created on the current thread while it
+ * is alive, for events that do not specify them.
+ *
+ * Attributes used by many events can be registered once as a set and shared
+ * by all of them through an `nvtx3::attr_id`, which also gives each set a
+ * compact id that backends and observers may record instead of the
+ * attributes.
  *
  * \subsection MESSAGES message
  *
@@ -363,6 +403,15 @@
  * nvtx3::registered_message<my_domain> const& msg =
  * nvtx3::registered_message<my_domain>::get<my_message>(); \endcode
  *
+ * For string literals, \ref NVTX3_REGISTERED_MESSAGE_IN and
+ * \ref NVTX3_REGISTERED_MESSAGE register the literal once per call site
+ * without defining a tag type:
+ *
+ * \code{.cpp}
+ * nvtx3::domain_thread_range<my_domain> r{
+ *    NVTX3_REGISTERED_MESSAGE_IN(my_domain, "my message")};
+ * \endcode
+ *
  * \subsection COLOR color
  *
  * Associating a `nvtx3::color` with an event allows controlling how the event
@@ -479,6 +528,73 @@
  * my_thread_range r{nvtx3::rgb{127, 255,0}, msg};
  *
  * \endcode
+ *
+ * \section FILTERING Filtering
+ *
+ * Events in a domain can be restricted to a subset of categories at runtime
+ * by installing a `nvtx3::event_filter` with `nvtx3::set_filter`. Ranges and
+ * marks whose category is not enabled are dropped before calling into NVTX,
+ * making excluded annotations nearly free.
+ *
+ * \code{.cpp}
+ * // Only record events in category 1 of `my_domain`
+ * static nvtx3::event_filter const f = nvtx3::event_filter{}.enable(1);
+ * nvtx3::set_filter<my_domain>(&f);
+ * \endcode
+ *
+ * \section ALGORITHMS Parallel Algorithms
+ *
+ * `nvtx3::for_each_chunked` and `nvtx3::transform_reduce`, declared in the
+ * separate header `nvtx3_algorithms.hpp`, process a range of elements in
+ * chunks, sequentially (`nvtx3::seq`) or on a built-in thread pool
+ * (`nvtx3::par`), annotating the whole call and every chunk with thread
+ * ranges to make load imbalance visible.
+ *
+ * \section OBSERVERS Observers
+ *
+ * The events of a domain can also be consumed in-process, without an NVTX
+ * injection library, by registering an `nvtx3::observer` with
+ * `nvtx3::add_observer`. Observers are invoked by the domain's ranges, marks
+ * and progress points on the thread creating the event, in addition to NVTX.
+ * `nvtx3::set_nvtx_enabled<D>(false)` stops forwarding the events of `D` to
+ * NVTX, leaving only its observers.
+ *
+ * \code{.cpp}
+ * struct latency_observer : nvtx3::observer {
+ *    void on_start(nvtx3::event_attributes const& attr,
+ *                  nvtx3::range_handle h) noexcept override { ... }
+ *    void on_end(nvtx3::range_handle h) noexcept override { ... }
+ * };
+ *
+ * static latency_observer latencies;
+ * nvtx3::add_observer<my_domain>(&latencies);
+ * \endcode
+ *
+ * `nvtx3::migration_tracker`, provided by `nvtx3_migration.hpp`, is an
+ * observer counting, per range message, how often a domain's thread ranges
+ * end on another CPU than they began on.
+ *
+ * \section BACKENDS Backends
+ *
+ * Where even a call into NVTX is too costly, a domain may statically select
+ * a different `nvtx3::backend` for its ranges and marks by declaring a
+ * `backend` member type, e.g., `nvtx3::backend::none` to compile its
+ * annotations out, or a user-defined backend derived from
+ * `nvtx3::backend::base` recording straight into a thread-local buffer.
+ * `nvtx3::backend::both` combines two backends.
+ *
+ * \code{.cpp}
+ * struct hot_domain{
+ *    static constexpr char const* name{"hot"};
+ *    using backend = nvtx3::backend::none;
+ * };
+ * \endcode
+ *
+ * Defining `NVTX3_DIRECT_DISPATCH` before including this header makes the
+ * `nvtx` backend call the implementations resolved by NVTX's initialization
+ * directly, from a per-domain table cached after the domain is created,
+ * rather than through the NVTX C API functions.
+ *
  * \section MACROS Convenience Macros
  *
  * Oftentimes users want to quickly and easily add NVTX ranges to their library
@@ -499,6 +615,17 @@
  *
  */
 
+#if defined(__x86_64__) || defined(__i386__)
+#define NVTX3_DETAIL_RDTSC() __builtin_ia32_rdtsc()
+#define NVTX3_DETAIL_HAS_TSC
+#elif defined(_M_X64) || defined(_M_IX86)
+// Declared directly rather than through the much larger <intrin.h>
+extern "C" unsigned __int64 __rdtsc();
+#pragma intrinsic(__rdtsc)
+#define NVTX3_DETAIL_RDTSC() __rdtsc()
+#define NVTX3_DETAIL_HAS_TSC
+#endif
+
 /**
  * @brief Enables the use of constexpr when support for C++14 relaxed constexpr
  * is present.
@@ -514,6 +641,15 @@
 #define NVTX3_RELAXED_CONSTEXPR
 #endif
 
+/**
+ * @brief The maximum number of attribute sets in the registry used by
+ * `nvtx3::attr_id`.
+ *
+ */
+#ifndef NVTX3_ATTRIBUTE_REGISTRY_CAPACITY
+#define NVTX3_ATTRIBUTE_REGISTRY_CAPACITY 1024
+#endif
+
 namespace nvtx3 {
 namespace detail {
 
@@ -1467,6 +1603,201 @@ class payload {
   value_type value_;              ///< Union holding the payload value
 };
 
+class event_attributes;
+
+namespace detail {
+
+/**
+ * @brief The attribute set by an argument of the `event_attributes`
+ * constructor.
+ *
+ */
+enum class attribute_kind { none, category, color, payload, message };
+
+/**
+ * @brief Determines the `attribute_kind` of an argument of type `T`.
+ *
+ */
+template <typename T>
+struct kind_of
+    : std::integral_constant<
+          attribute_kind,
+          std::is_convertible<T, category>::value
+              ? attribute_kind::category
+              : std::is_convertible<T, color>::value
+                    ? attribute_kind::color
+                    : std::is_convertible<T, payload>::value
+                          ? attribute_kind::payload
+                          : std::is_convertible<T, message>::value
+                                ? attribute_kind::message
+                                : attribute_kind::none> {};
+
+/**
+ * @brief Counts the types in `Args...` of the `attribute_kind` `K`.
+ *
+ */
+template <attribute_kind K, typename... Args>
+struct count_kind : std::integral_constant<std::size_t, 0> {};
+
+template <attribute_kind K, typename First, typename... Rest>
+struct count_kind<K, First, Rest...>
+    : std::integral_constant<std::size_t,
+                             (kind_of<First>::value == K ? 1 : 0) +
+                                 count_kind<K, Rest...>::value> {};
+
+/**
+ * @brief Fields of `nvtxEventAttributes_t` and how to obtain them from an
+ * attribute of their kind.
+ *
+ * `none()` is the value of the field when no attribute of its kind is given.
+ */
+struct category_field {
+  static constexpr attribute_kind kind{attribute_kind::category};
+  using value_type = decltype(nvtxEventAttributes_t::category);
+  static constexpr value_type none() noexcept { return 0; }
+  static constexpr value_type get(category const& c) noexcept {
+    return c.get_id();
+  }
+};
+
+struct color_type_field {
+  static constexpr attribute_kind kind{attribute_kind::color};
+  using value_type = decltype(nvtxEventAttributes_t::colorType);
+  static constexpr value_type none() noexcept { return NVTX_COLOR_UNKNOWN; }
+  static constexpr value_type get(color const& c) noexcept {
+    return static_cast<value_type>(c.get_type());
+  }
+};
+
+struct color_value_field {
+  static constexpr attribute_kind kind{attribute_kind::color};
+  using value_type = decltype(nvtxEventAttributes_t::color);
+  static constexpr value_type none() noexcept { return 0; }
+  static constexpr value_type get(color const& c) noexcept {
+    return c.get_value();
+  }
+};
+
+struct payload_type_field {
+  static constexpr attribute_kind kind{attribute_kind::payload};
+  using value_type = decltype(nvtxEventAttributes_t::payloadType);
+  static constexpr value_type none() noexcept { return NVTX_PAYLOAD_UNKNOWN; }
+  static NVTX3_RELAXED_CONSTEXPR value_type get(payload const& p) noexcept {
+    return static_cast<value_type>(p.get_type());
+  }
+};
+
+struct payload_value_field {
+  static constexpr attribute_kind kind{attribute_kind::payload};
+  using value_type = payload::value_type;
+  static constexpr value_type none() noexcept { return value_type{}; }
+  static NVTX3_RELAXED_CONSTEXPR value_type get(payload const& p) noexcept {
+    return p.get_value();
+  }
+};
+
+struct message_type_field {
+  static constexpr attribute_kind kind{attribute_kind::message};
+  using value_type = decltype(nvtxEventAttributes_t::messageType);
+  static constexpr value_type none() noexcept { return NVTX_MESSAGE_UNKNOWN; }
+  static NVTX3_RELAXED_CONSTEXPR value_type get(message const& m) noexcept {
+    return static_cast<value_type>(m.get_type());
+  }
+};
+
+struct message_value_field {
+  static constexpr attribute_kind kind{attribute_kind::message};
+  using value_type = message::value_type;
+  static constexpr value_type none() noexcept { return value_type{}; }
+  static NVTX3_RELAXED_CONSTEXPR value_type get(message const& m) noexcept {
+    return m.get_value();
+  }
+};
+
+/**
+ * @brief Index of the first type in `Args...` of the `attribute_kind` `K`, or
+ * `sizeof...(Args)` if there is none.
+ *
+ */
+template <attribute_kind K, typename... Args>
+struct find_kind : std::integral_constant<std::size_t, 0> {};
+
+template <attribute_kind K, typename First, typename... Rest>
+struct find_kind<K, First, Rest...>
+    : std::integral_constant<std::size_t,
+                             kind_of<First>::value == K
+                                 ? 0
+                                 : 1 + find_kind<K, Rest...>::value> {};
+
+/**
+ * @brief Compile-time sequence of indices, as `std::index_sequence` in C++14.
+ *
+ */
+template <std::size_t... Is>
+struct index_sequence {};
+
+template <std::size_t N, std::size_t... Is>
+struct make_index_sequence : make_index_sequence<N - 1, N - 1, Is...> {};
+
+template <std::size_t... Is>
+struct make_index_sequence<0, Is...> {
+  using type = index_sequence<Is...>;
+};
+
+/// Parameter type swallowing the address of an argument preceding the one
+/// selected by `select`
+template <std::size_t>
+using skipped = void const*;
+
+/**
+ * @brief Obtains the value of `Field` from the addresses of the arguments of
+ * the `event_attributes` constructor.
+ *
+ * `Skip` holds one index per argument preceding the first argument of
+ * `Field`'s kind. The overloads of `get` skip those arguments by their
+ * parameter list alone, so the value of every field is selected by a single
+ * call, whatever the number and order of the arguments.
+ */
+template <typename Field, typename Skip>
+struct select;
+
+template <typename Field, std::size_t... Skip>
+struct select<Field, index_sequence<Skip...>> {
+  /// The argument of `Field`'s kind is the one following the skipped ones.
+  /// The addresses of the arguments after it are passed as C variadic
+  /// arguments, so they are not part of the instantiation.
+  template <typename T>
+  static constexpr typename Field::value_type get(skipped<Skip>...,
+                                                  T const* attr,
+                                                  ...) noexcept {
+    return Field::get(*attr);
+  }
+
+  /// Every argument was skipped, there is none of `Field`'s kind
+  static constexpr typename Field::value_type get(skipped<Skip>...) noexcept {
+    return Field::none();
+  }
+};
+
+/**
+ * @brief The `select` for `Field` among arguments of the types `Args...`.
+ *
+ */
+template <typename Field, typename... Args>
+using select_in = select<
+    Field, typename make_index_sequence<
+               find_kind<Field::kind, Args...>::value>::type>;
+
+/**
+ * @brief Grants NVTX++ internals write access to the fields of an
+ * `event_attributes`.
+ *
+ */
+struct attributes_access {
+  static nvtxEventAttributes_t& fields(event_attributes& attr) noexcept;
+};
+}  // namespace detail
+
 /**
  * @brief Describes the attributes of a NVTX event.
  *
@@ -1512,10 +1843,8 @@ class payload {
  *                      "message",
  *                      nvtx3::rgb{127, 255, 0}};
  *
- * // Multiple arguments of the same type are allowed, but only the first is
- * // used. All others are ignored
- * event_attributes attr{ nvtx3::payload{42}, nvtx3::payload{7} }; // payload
- * is 42
+ * // At most one argument of each kind is allowed. This does not compile:
+ * event_attributes attr{ nvtx3::payload{42}, nvtx3::payload{7} };
  *
  * // Range `r` will be customized according the attributes in `attr`
  * nvtx3::thread_range r{attr};
@@ -1544,68 +1873,65 @@ class event_attributes {
             NVTX_COLOR_UNKNOWN,            // color type
             0,                             // color value
             NVTX_PAYLOAD_UNKNOWN,          // payload type
-            0,                             // payload value (union)
+            0,                             // reserved
+            {0},                           // payload value (union)
             NVTX_MESSAGE_UNKNOWN,          // message type
-            0                              // message value (union)
+            {0}                            // message value (union)
         } {}
 
   /**
-   * @brief Variadic constructor where the first argument is a `category`.
-   *
-   * Sets the value of the `EventAttribute`s category based on `c` and
-   * forwards the remaining variadic parameter pack to the next constructor.
-   *
-   */
-  template <typename... Args>
-  NVTX3_RELAXED_CONSTEXPR explicit event_attributes(
-      category const& c, Args const&... args) noexcept
-      : event_attributes(args...) {
-    attributes_.category = c.get_id();
-  }
-
-  /**
-   * @brief Variadic constructor where the first argument is a `color`.
-   *
-   * Sets the value of the `EventAttribute`s color based on `c` and forwards
-   * the remaining variadic parameter pack to the next constructor.
-   *
-   */
-  template <typename... Args>
-  NVTX3_RELAXED_CONSTEXPR explicit event_attributes(
-      color const& c, Args const&... args) noexcept
-      : event_attributes(args...) {
-    attributes_.color = c.get_value();
-    attributes_.colorType = c.get_type();
-  }
-
-  /**
-   * @brief Variadic constructor where the first argument is a `payload`.
-   *
-   * Sets the value of the `EventAttribute`s payload based on `p` and forwards
-   * the remaining variadic parameter pack to the next constructor.
+   * @brief Constructs an `event_attributes` from any number of attributes,
+   * in any order.
    *
-   */
-  template <typename... Args>
-  NVTX3_RELAXED_CONSTEXPR explicit event_attributes(
-      payload const& p, Args const&... args) noexcept
-      : event_attributes(args...) {
-    attributes_.payload = p.get_value();
-    attributes_.payloadType = p.get_type();
-  }
-
-  /**
-   * @brief Variadic constructor where the first argument is a `message`.
+   * Each argument must be convertible to one of `category`, `color`,
+   * `payload`, or `message`, and at most one argument of each kind may be
+   * given. Every field is initialized exactly once, so the constructor is a
+   * constant expression whenever its arguments are, e.g., for categories and
+   * colors in C++11 and for all attributes in C++14.
    *
-   * Sets the value of the `EventAttribute`s message based on `m` and forwards
-   * the remaining variadic parameter pack to the next constructor.
+   * Example:
+   * \code{.cpp}
+   * nvtx3::event_attributes attr{nvtx3::rgb{127, 255, 0}, "message",
+   *                              nvtx3::category{1}};
+   * \endcode
    *
    */
-  template <typename... Args>
-  NVTX3_RELAXED_CONSTEXPR explicit event_attributes(
-      message const& m, Args const&... args) noexcept
-      : event_attributes(args...) {
-    attributes_.message = m.get_value();
-    attributes_.messageType = m.get_type();
+  template <typename... Args,
+            typename = typename std::enable_if<
+                detail::count_kind<detail::attribute_kind::none,
+                                   Args&&...>::value == 0>::type>
+  constexpr explicit event_attributes(Args&&... args) noexcept
+      : attributes_{
+            NVTX_VERSION,                                        // version
+            sizeof(nvtxEventAttributes_t),                       // size
+            detail::select_in<detail::category_field, Args&&...>::get(
+                &args...),  // category
+            detail::select_in<detail::color_type_field, Args&&...>::get(
+                &args...),  // color type
+            detail::select_in<detail::color_value_field, Args&&...>::get(
+                &args...),  // color
+            detail::select_in<detail::payload_type_field, Args&&...>::get(
+                &args...),  // payload type
+            0,              // reserved
+            detail::select_in<detail::payload_value_field, Args&&...>::get(
+                &args...),  // payload
+            detail::select_in<detail::message_type_field, Args&&...>::get(
+                &args...),  // message type
+            detail::select_in<detail::message_value_field, Args&&...>::get(
+                &args...)  // message
+        } {
+    static_assert(detail::count_kind<detail::attribute_kind::category,
+                                     Args&&...>::value <= 1,
+                  "event_attributes accepts at most one category.");
+    static_assert(detail::count_kind<detail::attribute_kind::color,
+                                     Args&&...>::value <= 1,
+                  "event_attributes accepts at most one color.");
+    static_assert(detail::count_kind<detail::attribute_kind::payload,
+                                     Args&&...>::value <= 1,
+                  "event_attributes accepts at most one payload.");
+    static_assert(detail::count_kind<detail::attribute_kind::message,
+                                     Args&&...>::value <= 1,
+                  "event_attributes accepts at most one message.");
   }
 
   ~event_attributes() = default;
@@ -1621,134 +1947,355 @@ class event_attributes {
   constexpr value_type const* get() const noexcept { return &attributes_; }
 
  private:
+  friend struct detail::attributes_access;
+
   value_type attributes_{};  ///< The NVTX attributes structure
 };
 
+inline nvtxEventAttributes_t& detail::attributes_access::fields(
+    event_attributes& attr) noexcept {
+  return attr.attributes_;
+}
+
+namespace detail {
+
 /**
- * @brief A RAII object for creating a NVTX range local to a thread within a
- * domain.
- *
- * When constructed, begins a nested NVTX range on the calling thread in the
- * specified domain. Upon destruction, ends the NVTX range.
+ * @brief Returns the storage of the attribute registry.
  *
- * Behavior is undefined if a `domain_thread_range` object is
- * created/destroyed on different threads.
+ * Only the storage exists up front. Each entry is copied in at runtime by
+ * `register_attributes` when the `attr_id` owning it is first used.
+ */
+inline event_attributes* attribute_table() noexcept {
+  static event_attributes table[NVTX3_ATTRIBUTE_REGISTRY_CAPACITY];
+  return table;
+}
+
+/**
+ * @brief Returns the flags indicating which entries of the attribute registry
+ * are completely written.
  *
- * `domain_thread_range` is neither moveable nor copyable.
+ */
+inline std::atomic<bool>* attribute_ready() noexcept {
+  static std::atomic<bool> ready[NVTX3_ATTRIBUTE_REGISTRY_CAPACITY];
+  return ready;
+}
+
+/**
+ * @brief Returns the number of ids handed out by the attribute registry.
  *
- * `domain_thread_range`s may be nested within other ranges.
+ */
+inline std::atomic<uint32_t>& attribute_count() noexcept {
+  static std::atomic<uint32_t> count{0};
+  return count;
+}
+
+/**
+ * @brief Copies `attr` into the attribute registry, returning its id, or `0`
+ * if the registry is full.
  *
- * The domain of the range is specified by the template type parameter `D`.
- * By default, the `domain::global` is used, which scopes the range to the
- * global NVTX domain. The convenience alias `thread_range` is provided for
- * ranges scoped to the global domain.
+ * The entry is published by its ready flag only after it was written, so
+ * `find_attributes` never observes a partially written entry.
+ */
+inline uint32_t register_attributes(event_attributes const& attr) noexcept {
+  uint32_t const index{attribute_count().fetch_add(1)};
+  if (index >= NVTX3_ATTRIBUTE_REGISTRY_CAPACITY) {
+    return 0;
+  }
+  attribute_table()[index] = attr;
+  attribute_ready()[index].store(true, std::memory_order_release);
+  return index + 1;
+}
+}  // namespace detail
+
+/**
+ * @brief Identifies an immutable set of event attributes shared by every
+ * event created from it.
  *
- * A custom domain can be defined by creating a type, `D`, with a static
- * member `D::name` whose value is used to name the domain associated with
- * `D`. `D::name` must resolve to either `char const*` or `wchar_t const*`
+ * Creating a range or mark from an `event_attributes` builds a copy of the
+ * attributes for every event. An `attr_id<T>` instead refers to a single copy
+ * of the attributes returned by `T::attributes()`, built on first use and
+ * stored in a process-wide registry, where it is identified by a compact id.
  *
- * Example:
- * ```
- * // Define a type `my_domain` with a member `name` used to name the domain
- * // associated with the type `my_domain`.
- * struct my_domain{
- *    static constexpr const char * name{"my domain"};
- * };
- * ```
+ * A backend or `observer` that understands ids can recover the id of the
+ * attributes of an event with `attribute_id` and record only the id; the
+ * attributes can be looked up again with `find_attributes`.
  *
- * Usage:
- * ```
- * nvtx3::domain_thread_range<> r0{"range 0"}; // Range in global domain
+ * The registry holds up to `NVTX3_ATTRIBUTE_REGISTRY_CAPACITY` (default 1024)
+ * attribute sets. Sets created after it is full are still usable but have
+ * the id `0`.
  *
- * nvtx3::thread_range r1{"range 1"}; // Alias for range in global domain
+ * Events created from an `attr_id` ignore the calling thread's
+ * `scoped_defaults`, as merging the defaults would produce a copy that is no
+ * longer identified by the id.
  *
- * nvtx3::domain_thread_range<my_domain> r2{"range 2"}; // Range in custom
- * domain
+ * Example:
+ * \code{.cpp}
+ * struct compaction {
+ *    static constexpr char const* message{"compaction"};
+ *    static nvtx3::event_attributes attributes() {
+ *       return nvtx3::event_attributes{
+ *          nvtx3::registered_message<my_domain>::get<compaction>(),
+ *          nvtx3::rgb{0, 0, 255}, nvtx3::category{3}};
+ *    }
+ * };
  *
- * // specify an alias to a range that uses a custom domain
- * using my_thread_range = nvtx3::domain_thread_range<my_domain>;
+ * nvtx3::domain_thread_range<my_domain> r{nvtx3::attr_id<compaction>{}};
+ * \endcode
  *
- * my_thread_range r3{"range 3"}; // Alias for range in custom domain
- * ```
+ * @tparam T Type with a static member function `T::attributes()` returning the
+ * `event_attributes` of the set.
  */
-template <class D = domain::global>
-class domain_thread_range {
- public:
+template <typename T>
+struct attr_id {
   /**
-   * @brief Construct a `domain_thread_range` with the specified
-   * `event_attributes`
-   *
-   * Example:
-   * ```
-   * nvtx3::event_attributes attr{"msg", nvtx3::rgb{127,255,0}};
-   * nvtx3::domain_thread_range<> range{attr}; // Creates a range with message
-   * contents
-   *                                    // "msg" and green color
-   * ```
+   * @brief Returns the shared attributes of the set.
    *
-   * @param[in] attr `event_attributes` that describes the desired attributes
-   * of the range.
    */
-  explicit domain_thread_range(event_attributes const& attr) noexcept {
-    nvtxDomainRangePushEx(domain::get<D>(), attr.get());
+  static event_attributes const& attributes() noexcept {
+    return *entry().attributes;
   }
 
   /**
-   * @brief Constructs a `domain_thread_range` from the constructor arguments
-   * of an `event_attributes`.
-   *
-   * Forwards the arguments `first, args...` to construct an
-   * `event_attributes` object. The `event_attributes` object is then
-   * associated with the `domain_thread_range`.
-   *
-   * For more detail, see `event_attributes` documentation.
-   *
-   * Example:
-   * ```
-   * // Creates a range with message "message" and green color
-   * nvtx3::domain_thread_range<> r{"message", nvtx3::rgb{127,255,0}};
-   * ```
-   *
-   * @note To prevent making needless copies of `event_attributes` objects,
-   * this constructor is disabled when the first argument is an
-   * `event_attributes` object, instead preferring the explicit
-   * `domain_thread_range(event_attributes const&)` constructor.
-   *
-   * @param[in] first First argument to forward to the `event_attributes`
-   * constructor.
-   * @param[in] args Variadic parameter pack of additional arguments to
-   * forward.
+   * @brief Returns the id of the set, or `0` if the registry was full.
    *
    */
-  template <typename First, typename... Args,
-            typename = typename std::enable_if<not std::is_same<
-                event_attributes, typename std::decay<First>>::value>>
-  explicit domain_thread_range(First const& first, Args const&... args) noexcept
-      : domain_thread_range{event_attributes{first, args...}} {}
+  static uint32_t value() noexcept { return entry().id; }
+
+ private:
+  struct entry_type {
+    explicit entry_type(event_attributes const& attr) noexcept
+        : id{detail::register_attributes(attr)},
+          attributes{id == 0 ? unregistered(attr)
+                             : &detail::attribute_table()[id - 1]} {}
+
+    uint32_t const id;                         ///< Registry id, or `0`
+    event_attributes const* const attributes;  ///< The shared attributes
+  };
 
   /**
-   * @brief Default constructor creates a `domain_thread_range` with no
-   * message, color, payload, nor category.
+   * @brief Returns a private copy of `attr`, only built for a set that did
+   * not fit in the registry.
    *
    */
-  domain_thread_range() : domain_thread_range{event_attributes{}} {}
+  static event_attributes const* unregistered(
+      event_attributes const& attr) noexcept {
+    static event_attributes const copy{attr};
+    return &copy;
+  }
 
-  domain_thread_range(domain_thread_range const&) = delete;
-  domain_thread_range& operator=(domain_thread_range const&) = delete;
-  domain_thread_range(domain_thread_range&&) = delete;
-  domain_thread_range& operator=(domain_thread_range&&) = delete;
+  static entry_type const& entry() noexcept {
+    static entry_type const e{T::attributes()};
+    return e;
+  }
+};
+
+/**
+ * @brief Returns the id of `attr` if it is the shared copy of an `attr_id`'s
+ * attributes, else `0`.
+ *
+ * @param attr The attributes of an event
+ */
+inline uint32_t attribute_id(event_attributes const& attr) noexcept {
+  auto const table = detail::attribute_table();
+  std::less<event_attributes const*> const less{};
+  if (less(&attr, table) or
+      not less(&attr, table + NVTX3_ATTRIBUTE_REGISTRY_CAPACITY)) {
+    return 0;
+  }
+  return static_cast<uint32_t>(&attr - table) + 1;
+}
+
+/**
+ * @brief Returns the attributes registered with the id `id`, or `nullptr` if
+ * there are none.
+ *
+ * @param id An id returned by `attr_id::value` or `attribute_id`
+ */
+inline event_attributes const* find_attributes(uint32_t id) noexcept {
+  if (id == 0 or id > NVTX3_ATTRIBUTE_REGISTRY_CAPACITY or
+      not detail::attribute_ready()[id - 1].load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return &detail::attribute_table()[id - 1];
+}
+
+/**
+ * @brief Immutable set of `category` ids whose events are enabled within a
+ * domain.
+ *
+ * An `event_filter` is installed for a domain via `set_filter<D>()`. While
+ * installed, ranges and marks in that domain whose category is not enabled by
+ * the filter are dropped before any call into NVTX is made. Dropping an event
+ * costs a single load of the installed filter, a bit test, and a branch.
+ *
+ * Category ids below `capacity` are tracked individually. All ids greater
+ * than or equal to `capacity` share a single bit, see `enable_overflow()`.
+ *
+ * Example:
+ * \code{.cpp}
+ * // Only record events in categories 1 and 3 of `my_domain`
+ * static nvtx3::event_filter const f =
+ *    nvtx3::event_filter{}.enable(1).enable(3);
+ * nvtx3::set_filter<my_domain>(&f);
+ *
+ * nvtx3::domain_thread_range<my_domain> r0{nvtx3::category{1}}; // Recorded
+ * nvtx3::domain_thread_range<my_domain> r1{nvtx3::category{2}}; // Dropped
+ *
+ * // Remove the filter, all events in `my_domain` are recorded again
+ * nvtx3::set_filter<my_domain>(nullptr);
+ * \endcode
+ */
+class event_filter {
+ public:
+  /// Type of the words holding the bitmap of enabled ids
+  using word_type = uint64_t;
+
+  /// Number of category ids tracked individually by the filter. An
+  /// enumerator, so it can be bound to references without a definition.
+  enum : std::size_t { capacity = 256 };
 
   /**
-   * @brief Destroy the domain_thread_range, ending the NVTX range event.
+   * @brief Constructs an `event_filter` with every category disabled.
+   *
+   */
+  constexpr event_filter() noexcept = default;
+
+  /**
+   * @brief Enables events in the category identified by `id`.
+   *
+   * @param id The category id to enable
+   * @return Reference to this filter to allow chaining
+   */
+  event_filter& enable(category::id_type id) noexcept {
+    if (id < capacity) {
+      words_[id / word_bits] |= word_type{1} << (id % word_bits);
+    } else {
+      overflow_ = true;
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Enables events in the category identified by `c`.
+   *
+   * @param c The category to enable
+   * @return Reference to this filter to allow chaining
+   */
+  event_filter& enable(category const& c) noexcept {
+    return enable(c.get_id());
+  }
+
+  /**
+   * @brief Disables events in the category identified by `id`.
+   *
+   * @param id The category id to disable
+   * @return Reference to this filter to allow chaining
+   */
+  event_filter& disable(category::id_type id) noexcept {
+    if (id < capacity) {
+      words_[id / word_bits] &= ~(word_type{1} << (id % word_bits));
+    } else {
+      overflow_ = false;
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Enables every category id, including those `>= capacity`.
+   *
+   * @return Reference to this filter to allow chaining
+   */
+  event_filter& enable_all() noexcept {
+    for (auto& w : words_) {
+      w = ~word_type{0};
+    }
+    overflow_ = true;
+    return *this;
+  }
+
+  /**
+   * @brief Enables every category id `>= capacity`.
+   *
+   * @return Reference to this filter to allow chaining
+   */
+  event_filter& enable_overflow() noexcept {
+    overflow_ = true;
+    return *this;
+  }
+
+  /**
+   * @brief Returns whether events in the category `id` pass the filter.
+   *
    */
-  ~domain_thread_range() noexcept { nvtxDomainRangePop(domain::get<D>()); }
+  constexpr bool is_enabled(category::id_type id) const noexcept {
+    return id < capacity ? ((words_[id / word_bits] >> (id % word_bits)) & 1)
+                         : overflow_;
+  }
+
+ private:
+  static constexpr std::size_t word_bits{sizeof(word_type) * 8};
+
+  word_type words_[capacity / word_bits]{};  ///< Bitmap of enabled ids
+  bool overflow_{false};  ///< Whether ids `>= capacity` are enabled
 };
 
+namespace detail {
+
 /**
- * @brief Alias for a `domain_thread_range` in the global NVTX domain.
+ * @brief Holds the `event_filter` currently installed for the domain `D`.
+ *
+ * A static data member of a class template is constant initialized, so
+ * reading it requires no "construct on first use" guard.
  *
  */
-using thread_range = domain_thread_range<>;
+template <typename D>
+struct filter_slot {
+  static std::atomic<event_filter const*> current;
+};
+
+template <typename D>
+std::atomic<event_filter const*> filter_slot<D>::current{nullptr};
+
+/**
+ * @brief Returns whether an event described by `attr` in the domain `D`
+ * passes the currently installed filter.
+ *
+ * Always `true` when no filter is installed for `D`.
+ */
+template <typename D>
+inline bool is_enabled(event_attributes const& attr) noexcept {
+  event_filter const* f =
+      filter_slot<D>::current.load(std::memory_order_acquire);
+  return f == nullptr or f->is_enabled(attr.get()->category);
+}
+}  // namespace detail
+
+/**
+ * @brief Installs `f` as the `event_filter` for the domain `D`.
+ *
+ * Replaces the previously installed filter with an atomic pointer swap, so
+ * the filter may be reconfigured at any time while other threads are creating
+ * events. Passing `nullptr` removes filtering for `D`.
+ *
+ * `f` is not copied and must outlive its use. As other threads may still be
+ * reading the previously installed filter when this function returns, filters
+ * are expected to have static storage duration.
+ *
+ * Ranges consult the filter once when they begin. A range that was dropped
+ * (or recorded) when it began remains so when it ends, regardless of filter
+ * changes made in between.
+ *
+ * @tparam D Type containing `name` member used to identify the `domain`
+ * to filter. Else, `domain::global` to indicate that the global NVTX domain
+ * should be filtered.
+ * @param f The filter to install, or `nullptr` to disable filtering
+ * @return The previously installed filter, or `nullptr` if there was none
+ */
+template <typename D = domain::global>
+inline event_filter const* set_filter(event_filter const* f) noexcept {
+  return detail::filter_slot<D>::current.exchange(f,
+                                                  std::memory_order_acq_rel);
+}
 
 /**
  * @brief Handle used for correlating explicit range start and end events.
@@ -1759,22 +2306,1101 @@ struct range_handle {
   using value_type = nvtxRangeId_t;
 
   /**
-   * @brief Construct a `range_handle` from the given id.
-   *
+   * @brief Construct a null `range_handle`.
+   *
+   */
+  constexpr range_handle() noexcept = default;
+
+  /**
+   * @brief Construct a `range_handle` from the given id.
+   *
+   */
+  constexpr range_handle(value_type id) noexcept : _range_id{id} {}
+
+  /**
+   * @brief Returns the `range_handle`'s value
+   *
+   * @return value_type The handle's value
+   */
+  constexpr value_type get_value() const noexcept { return _range_id; }
+
+private:
+  value_type _range_id{}; ///< The underlying NVTX range id
+};
+
+/**
+ * @brief Interface for receiving the events of a domain in-process.
+ *
+ * An `observer` registered for a domain with `add_observer<D>()` is invoked
+ * directly by the NVTX++ constructs of that domain, in addition to (or, see
+ * `set_nvtx_enabled`, instead of) calling into NVTX. This allows feeding
+ * ranges and marks into an application's own metrics without an NVTX
+ * injection library.
+ *
+ * Callbacks are invoked on the thread creating the event and must be
+ * thread-safe. Events dropped by the domain's `event_filter` are not
+ * observed. All callbacks have an empty default implementation.
+ *
+ * Example:
+ * \code{.cpp}
+ * struct counting_observer : nvtx3::observer {
+ *    void on_push(nvtx3::event_attributes const&) noexcept override {
+ *       ++pushes;
+ *    }
+ *    std::atomic<int> pushes{0};
+ * };
+ *
+ * static counting_observer counter;
+ * nvtx3::add_observer<my_domain>(&counter);
+ * \endcode
+ */
+class observer {
+ public:
+  virtual ~observer() = default;
+
+  /**
+   * @brief Invoked when a `domain_thread_range` begins.
+   *
+   * @param attr The attributes of the range
+   */
+  virtual void on_push(event_attributes const& /*attr*/) noexcept {}
+
+  /**
+   * @brief Invoked when a `domain_thread_range` ends, on the thread where it
+   * began.
+   *
+   */
+  virtual void on_pop() noexcept {}
+
+  /**
+   * @brief Invoked for every `mark`.
+   *
+   * @param attr The attributes of the mark
+   */
+  virtual void on_mark(event_attributes const& /*attr*/) noexcept {}
+
+  /**
+   * @brief Invoked when a `domain_process_range` begins.
+   *
+   * @param attr The attributes of the range
+   * @param handle Identifies the range in the matching `on_end`
+   */
+  virtual void on_start(event_attributes const& /*attr*/,
+                        range_handle /*handle*/) noexcept {}
+
+  /**
+   * @brief Invoked when a `domain_process_range` ends, possibly on a
+   * different thread than where it began.
+   *
+   * @param handle The handle passed to `on_start` for the range
+   */
+  virtual void on_end(range_handle /*handle*/) noexcept {}
+};
+
+namespace detail {
+
+/**
+ * @brief Holds the `observer`s registered for the domain `D` and whether its
+ * events are forwarded to NVTX.
+ *
+ * `size` is one past the highest slot ever used, so with no observers
+ * registered, notifying them costs a single load and branch. Removed
+ * observers leave an empty slot that is reused by later registrations.
+ */
+template <typename D>
+struct observer_slots {
+  static constexpr std::size_t capacity{8};
+  static std::atomic<observer*> slots[capacity];
+  static std::atomic<std::size_t> size;
+  static std::atomic<bool> nvtx_enabled;
+};
+
+template <typename D>
+constexpr std::size_t observer_slots<D>::capacity;
+
+template <typename D>
+std::atomic<observer*> observer_slots<D>::slots[capacity];
+
+template <typename D>
+std::atomic<std::size_t> observer_slots<D>::size{0};
+
+template <typename D>
+std::atomic<bool> observer_slots<D>::nvtx_enabled{true};
+
+/**
+ * @brief Serializes registration of observers across all domains.
+ *
+ */
+inline std::mutex& observer_registration_mutex() {
+  static std::mutex m;
+  return m;
+}
+
+/**
+ * @brief Invokes `f` with every observer registered for the domain `D`.
+ *
+ */
+template <typename D, typename F>
+inline void notify(F f) noexcept {
+  std::size_t const n{
+      observer_slots<D>::size.load(std::memory_order_acquire)};
+  for (std::size_t i = 0; i < n; ++i) {
+    if (observer* o =
+            observer_slots<D>::slots[i].load(std::memory_order_acquire)) {
+      f(*o);
+    }
+  }
+}
+
+/**
+ * @brief Returns whether events in the domain `D` are forwarded to NVTX.
+ *
+ */
+template <typename D>
+inline bool nvtx_enabled() noexcept {
+  return observer_slots<D>::nvtx_enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns a process-wide unique range id for observers when NVTX did
+ * not provide one.
+ *
+ */
+inline range_handle::value_type next_range_id() noexcept {
+  static std::atomic<range_handle::value_type> id{0};
+  return ++id;
+}
+
+#ifdef NVTX3_DIRECT_DISPATCH
+/**
+ * @brief The NVTX entry points used by NVTX++ events in a domain, resolved
+ * once NVTX is initialized.
+ *
+ * Each NVTX C API function loads its implementation from a global table
+ * whose entries initially point at initialization trampolines. Snapshotting
+ * the table together with the domain handle lets every event make a single
+ * null-checked indirect call through one cache line.
+ */
+struct alignas(64) dispatch_table {
+  nvtxDomainHandle_t domain;                 ///< Domain handle
+  nvtxDomainRangePushEx_impl_fntype push;    ///< Range push, or null
+  nvtxDomainRangePop_impl_fntype pop;        ///< Range pop, or null
+  nvtxDomainMarkEx_impl_fntype mark;         ///< Mark, or null
+  nvtxDomainRangeStartEx_impl_fntype start;  ///< Range start, or null
+  nvtxRangeEnd_impl_fntype end;              ///< Range end, or null
+};
+
+/**
+ * @brief Returns the `dispatch_table` of the domain `D`.
+ *
+ * NVTX is initialized explicitly before the table is read, as obtaining the
+ * handle of the global domain does not call into NVTX. Once initialized, the
+ * implementation pointers no longer change. A null pointer indicates no tool
+ * is attached.
+ */
+template <typename D>
+inline dispatch_table const& dispatch() noexcept {
+  static dispatch_table const table = [] {
+    nvtxInitialize(nullptr);
+    nvtxDomainHandle_t const d = domain::get<D>();
+    auto const& g = NVTX_VERSIONED_IDENTIFIER(nvtxGlobals);
+    return dispatch_table{d,
+                          g.nvtxDomainRangePushEx_impl_fnptr,
+                          g.nvtxDomainRangePop_impl_fnptr,
+                          g.nvtxDomainMarkEx_impl_fnptr,
+                          g.nvtxDomainRangeStartEx_impl_fnptr,
+                          g.nvtxRangeEnd_impl_fnptr};
+  }();
+  return table;
+}
+
+template <typename D>
+inline void nvtx_push(event_attributes const& attr) noexcept {
+  auto const& t = dispatch<D>();
+  if (t.push != nullptr) {
+    t.push(t.domain, attr.get());
+  }
+}
+
+template <typename D>
+inline void nvtx_pop() noexcept {
+  auto const& t = dispatch<D>();
+  if (t.pop != nullptr) {
+    t.pop(t.domain);
+  }
+}
+
+template <typename D>
+inline void nvtx_mark(event_attributes const& attr) noexcept {
+  auto const& t = dispatch<D>();
+  if (t.mark != nullptr) {
+    t.mark(t.domain, attr.get());
+  }
+}
+
+template <typename D>
+inline range_handle nvtx_start(event_attributes const& attr) noexcept {
+  auto const& t = dispatch<D>();
+  return t.start != nullptr ? range_handle{t.start(t.domain, attr.get())}
+                            : range_handle{};
+}
+
+template <typename D>
+inline void nvtx_end(range_handle h) noexcept {
+  auto const& t = dispatch<D>();
+  if (t.end != nullptr) {
+    t.end(h.get_value());
+  }
+}
+#else
+/**
+ * @brief Calls `nvtxDomainRangePushEx` in the domain `D`.
+ *
+ */
+template <typename D>
+inline void nvtx_push(event_attributes const& attr) noexcept {
+  nvtxDomainRangePushEx(domain::get<D>(), attr.get());
+}
+
+/**
+ * @brief Calls `nvtxDomainRangePop` in the domain `D`.
+ *
+ */
+template <typename D>
+inline void nvtx_pop() noexcept {
+  nvtxDomainRangePop(domain::get<D>());
+}
+
+/**
+ * @brief Calls `nvtxDomainMarkEx` in the domain `D`.
+ *
+ */
+template <typename D>
+inline void nvtx_mark(event_attributes const& attr) noexcept {
+  nvtxDomainMarkEx(domain::get<D>(), attr.get());
+}
+
+/**
+ * @brief Calls `nvtxDomainRangeStartEx` in the domain `D`.
+ *
+ */
+template <typename D>
+inline range_handle nvtx_start(event_attributes const& attr) noexcept {
+  return range_handle{nvtxDomainRangeStartEx(domain::get<D>(), attr.get())};
+}
+
+/**
+ * @brief Calls `nvtxRangeEnd` for a range begun in the domain `D`.
+ *
+ */
+template <typename D>
+inline void nvtx_end(range_handle h) noexcept {
+  nvtxRangeEnd(h.get_value());
+}
+#endif
+
+/**
+ * @brief Begins a thread range in the domain `D`.
+ *
+ */
+template <typename D>
+inline void push(event_attributes const& attr) noexcept {
+  if (nvtx_enabled<D>()) {
+    nvtx_push<D>(attr);
+  }
+  notify<D>([&attr](observer& o) { o.on_push(attr); });
+}
+
+/**
+ * @brief Ends the innermost thread range of the calling thread in the domain
+ * `D`.
+ *
+ */
+template <typename D>
+inline void pop() noexcept {
+  if (nvtx_enabled<D>()) {
+    nvtx_pop<D>();
+  }
+  notify<D>([](observer& o) { o.on_pop(); });
+}
+
+/**
+ * @brief Emits a mark in the domain `D`.
+ *
+ */
+template <typename D>
+inline void emit_mark(event_attributes const& attr) noexcept {
+  if (nvtx_enabled<D>()) {
+    nvtx_mark<D>(attr);
+  }
+  notify<D>([&attr](observer& o) { o.on_mark(attr); });
+}
+
+/**
+ * @brief Begins a process range in the domain `D`.
+ *
+ */
+template <typename D>
+inline range_handle start(event_attributes const& attr) noexcept {
+  range_handle h{0};
+  if (nvtx_enabled<D>()) {
+    h = nvtx_start<D>(attr);
+  }
+  if (observer_slots<D>::size.load(std::memory_order_acquire) != 0) {
+    if (h.get_value() == 0) {
+      h = range_handle{next_range_id()};
+    }
+    notify<D>([&attr, h](observer& o) { o.on_start(attr, h); });
+  }
+  return h;
+}
+
+/**
+ * @brief Ends the process range `h` begun in the domain `D`.
+ *
+ */
+template <typename D>
+inline void end(range_handle h) noexcept {
+  if (nvtx_enabled<D>()) {
+    nvtx_end<D>(h);
+  }
+  notify<D>([h](observer& o) { o.on_end(h); });
+}
+}  // namespace detail
+
+/**
+ * @brief Registers `o` to observe the events of the domain `D`.
+ *
+ * Up to eight observers may be registered per domain. `o` is not copied and
+ * must remain valid until it is removed with `remove_observer`, and for as
+ * long as other threads may still be invoking it afterwards. Observers are
+ * therefore expected to have static storage duration.
+ *
+ * Observers only see ranges that begin after they are registered. An
+ * observer registered while ranges are open may see their end without their
+ * beginning.
+ *
+ * @tparam D Type containing `name` member used to identify the `domain` to
+ * observe. Else, `domain::global` to indicate that the global NVTX domain
+ * should be observed.
+ * @param o The observer to register
+ * @return `true` if `o` was registered, `false` if all slots are in use
+ */
+template <typename D = domain::global>
+inline bool add_observer(observer* o) noexcept {
+  using slots = detail::observer_slots<D>;
+  std::lock_guard<std::mutex> lock{detail::observer_registration_mutex()};
+  for (std::size_t i = 0; i < slots::capacity; ++i) {
+    if (slots::slots[i].load(std::memory_order_relaxed) == nullptr) {
+      slots::slots[i].store(o, std::memory_order_release);
+      if (slots::size.load(std::memory_order_relaxed) <= i) {
+        slots::size.store(i + 1, std::memory_order_release);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Unregisters `o` from the domain `D`.
+ *
+ * Other threads may still be invoking `o` when this function returns.
+ *
+ * @param o The observer to unregister
+ * @return `true` if `o` was registered, `false` otherwise
+ */
+template <typename D = domain::global>
+inline bool remove_observer(observer* o) noexcept {
+  using slots = detail::observer_slots<D>;
+  std::lock_guard<std::mutex> lock{detail::observer_registration_mutex()};
+  for (std::size_t i = 0; i < slots::capacity; ++i) {
+    if (slots::slots[i].load(std::memory_order_relaxed) == o) {
+      slots::slots[i].store(nullptr, std::memory_order_release);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Sets whether the events of the domain `D` are forwarded to NVTX.
+ *
+ * Forwarding is enabled by default. Disabling it makes the NVTX++ constructs
+ * of `D` report their events only to the domain's observers, bypassing NVTX
+ * entirely. Change it only while no ranges of `D` are open.
+ *
+ * Only ranges, marks and progress points are affected. Registration of
+ * messages and categories is always forwarded to NVTX.
+ *
+ * @param enabled Whether to forward events to NVTX
+ */
+template <typename D = domain::global>
+inline void set_nvtx_enabled(bool enabled) noexcept {
+  detail::observer_slots<D>::nvtx_enabled.store(enabled,
+                                                std::memory_order_relaxed);
+}
+
+namespace backend {
+struct nvtx;
+}  // namespace backend
+
+/**
+ * @brief Tracks the thread ranges of a fiber (user-level thread) so they can
+ * follow the fiber across context switches.
+ *
+ * NVTX thread ranges form a stack per OS thread. When an M:N fiber scheduler
+ * switches OS threads between fibers, ranges pushed by one fiber would
+ * otherwise appear nested inside the ranges of whichever fiber ran before it.
+ *
+ * A scheduler creates one `fiber_context` per fiber and calls
+ * `fiber_context::switch_to` on every switch. While a `fiber_context` is
+ * current on a thread, every `domain_thread_range<D>` begun on that thread is
+ * recorded in it. On a switch, the outgoing fiber's ranges are popped from the
+ * OS thread and the incoming fiber's ranges are pushed again, outermost first,
+ * so each OS thread's NVTX stack always reflects the fiber running on it.
+ *
+ * Ranges are re-pushed with the attributes they were created with, except
+ * that only messages that are `registered_message`s are retained, as any other
+ * string may no longer be valid when the fiber resumes. Ranges with other
+ * messages are re-pushed with their category, color and payload only, and
+ * are counted by `dropped_messages()`.
+ *
+ * Recording a range never allocates: a `fiber_context` holds up to the
+ * `capacity` passed on construction. Ranges nested deeper than that are
+ * re-pushed without any attributes and are also counted by
+ * `dropped_messages()`.
+ *
+ * Example:
+ * \code{.cpp}
+ * struct fiber {
+ *    nvtx3::fiber_context<my_domain> nvtx;
+ *    ...
+ * };
+ *
+ * void scheduler::resume(fiber& f){
+ *    nvtx3::fiber_context<my_domain>::switch_to(&f.nvtx);
+ *    swapcontext(&scheduler_context, &f.context);
+ *    nvtx3::fiber_context<my_domain>::switch_to(nullptr);
+ * }
+ * \endcode
+ *
+ * Behavior is undefined if a `fiber_context` is destroyed while it still
+ * holds open ranges or is current on any thread.
+ *
+ * @tparam D Type containing `name` member used to identify the `domain`
+ * whose ranges are tracked. Else, `domain::global` to indicate that the
+ * global NVTX domain should be used.
+ */
+template <typename D = domain::global>
+class fiber_context {
+ public:
+  /// Default maximum number of ranges recorded with their attributes
+  static constexpr std::size_t default_capacity{32};
+
+  /**
+   * @brief Constructs a `fiber_context` recording the attributes of up to
+   * `capacity` nested ranges.
+   *
+   */
+  explicit fiber_context(std::size_t capacity = default_capacity) {
+    ranges_.reserve(capacity);
+  }
+
+  ~fiber_context() = default;
+  fiber_context(fiber_context const&) = delete;
+  fiber_context& operator=(fiber_context const&) = delete;
+  fiber_context(fiber_context&&) = delete;
+  fiber_context& operator=(fiber_context&&) = delete;
+
+  /**
+   * @brief Returns the `fiber_context` current on the calling thread, or
+   * `nullptr` if no fiber is running on it.
+   *
+   */
+  static fiber_context* current() noexcept { return current_; }
+
+  /**
+   * @brief Switches the calling thread from the current fiber to `next`.
+   *
+   * Pops the ranges of the current fiber, if any, from the calling thread and
+   * pushes the ranges of `next`, if any. Nothing is replayed while NVTX is
+   * disabled for `D` with `set_nvtx_enabled`, as the ranges were not pushed
+   * to NVTX either. Passing `nullptr` indicates that the
+   * thread returns to code that does not run on a fiber, e.g., the scheduler.
+   *
+   * @param next The context of the fiber about to run on the calling thread,
+   * or `nullptr`
+   */
+  static void switch_to(fiber_context* next) noexcept {
+    if (current_ == next) {
+      return;
+    }
+    if (not detail::nvtx_enabled<D>()) {
+      current_ = next;
+      return;
+    }
+    if (current_ != nullptr) {
+      for (std::size_t i = 0; i < current_->depth(); ++i) {
+        detail::nvtx_pop<D>();
+      }
+    }
+    current_ = next;
+    if (next != nullptr) {
+      for (auto const& attr : next->ranges_) {
+        detail::nvtx_push<D>(attr);
+      }
+      for (std::size_t i = 0; i < next->overflow_; ++i) {
+        detail::nvtx_push<D>(event_attributes{});
+      }
+    }
+  }
+
+  /**
+   * @brief Returns the number of ranges currently open on the fiber.
+   *
+   */
+  std::size_t depth() const noexcept { return ranges_.size() + overflow_; }
+
+  /**
+   * @brief Returns the number of ranges recorded so far whose message was not
+   * retained, either because it was not a `registered_message` or because
+   * the range exceeded the capacity of the `fiber_context`.
+   *
+   */
+  std::size_t dropped_messages() const noexcept { return dropped_; }
+
+ private:
+  friend struct backend::nvtx;
+
+  /**
+   * @brief Records a range begun while the fiber is running.
+   *
+   */
+  void record(event_attributes const& attr) noexcept {
+    auto const type = attr.get()->messageType;
+    bool const retained{type == NVTX_MESSAGE_UNKNOWN or
+                        type == NVTX_MESSAGE_TYPE_REGISTERED};
+    if (ranges_.size() == ranges_.capacity()) {
+      ++overflow_;
+      dropped_ += type != NVTX_MESSAGE_UNKNOWN;
+      return;
+    }
+    ranges_.push_back(attr);
+    if (not retained) {
+      auto& fields = detail::attributes_access::fields(ranges_.back());
+      fields.messageType = NVTX_MESSAGE_UNKNOWN;
+      fields.message.ascii = nullptr;
+      ++dropped_;
+    }
+  }
+
+  /**
+   * @brief Removes the innermost range recorded with `record`.
+   *
+   */
+  void erase() noexcept {
+    if (overflow_ > 0) {
+      --overflow_;
+    } else {
+      ranges_.pop_back();
+    }
+  }
+
+  static thread_local fiber_context* current_;  ///< Context of the fiber
+                                                ///< running on this thread
+
+  std::vector<event_attributes> ranges_;  ///< Open ranges, outermost first,
+                                          ///< never grown past capacity
+  std::size_t overflow_{0};  ///< Open ranges beyond the capacity of `ranges_`
+  std::size_t dropped_{0};   ///< Ranges whose message was not retained
+};
+
+template <typename D>
+constexpr std::size_t fiber_context<D>::default_capacity;
+
+template <typename D>
+thread_local fiber_context<D>* fiber_context<D>::current_{nullptr};
+
+/**
+ * @brief Backends receive the events of NVTX++ ranges and marks.
+ *
+ * The backend of a range or mark is a template parameter, so events are
+ * dispatched to it statically and can be inlined. It defaults to the type
+ * `D::backend` of the domain `D`, if present, else `backend::nvtx`.
+ *
+ * A backend is a type with the static member functions of `backend::base`,
+ * a `handle_type` identifying process ranges, and a constant `active`. When
+ * `active` is `false`, ranges and marks skip the domain's `event_filter` and
+ * the backend is never invoked. Custom backends should therefore derive from
+ * `backend::base`, which is active and ignores every event, and hide only the
+ * functions for the events they handle.
+ *
+ * Example:
+ * \code{.cpp}
+ * // Records thread ranges straight into a thread-local buffer
+ * struct trace_backend : nvtx3::backend::base {
+ *    template <typename D>
+ *    static void push(nvtx3::event_attributes const& attr) noexcept {
+ *       buffer().push_back({attr.get()->category, now()});
+ *    }
+ *    ...
+ * };
+ *
+ * struct hot_domain {
+ *    static constexpr char const* name{"hot"};
+ *    using backend = trace_backend;
+ * };
+ * \endcode
+ */
+namespace backend {
+
+/**
+ * @brief Active backend ignoring all events, to derive custom backends from.
+ *
+ */
+struct base {
+  using handle_type = range_handle;
+  static constexpr bool active{true};
+
+  template <typename D>
+  static void push(event_attributes const&) noexcept {}
+
+  template <typename D>
+  static void pop() noexcept {}
+
+  template <typename D>
+  static void mark(event_attributes const&) noexcept {}
+
+  template <typename D>
+  static handle_type start(event_attributes const&) noexcept {
+    return handle_type{0};
+  }
+
+  template <typename D>
+  static void end(handle_type) noexcept {}
+};
+
+/**
+ * @brief Backend discarding all events.
+ *
+ * Being inactive, ranges and marks using it skip the domain's `event_filter`
+ * and compile to nothing.
+ */
+struct none : base {
+  static constexpr bool active{false};
+};
+
+/**
+ * @brief Backend forwarding events to NVTX and the domain's `observer`s.
+ *
+ * Thread ranges are also recorded in the `fiber_context` current on the
+ * calling thread, if any.
+ */
+struct nvtx {
+  using handle_type = range_handle;
+  static constexpr bool active{true};
+
+  template <typename D>
+  static void push(event_attributes const& attr) noexcept {
+    detail::push<D>(attr);
+    if (auto fiber = fiber_context<D>::current()) {
+      fiber->record(attr);
+    }
+  }
+
+  template <typename D>
+  static void pop() noexcept {
+    detail::pop<D>();
+    if (auto fiber = fiber_context<D>::current()) {
+      fiber->erase();
+    }
+  }
+
+  template <typename D>
+  static void mark(event_attributes const& attr) noexcept {
+    detail::emit_mark<D>(attr);
+  }
+
+  template <typename D>
+  static handle_type start(event_attributes const& attr) noexcept {
+    return detail::start<D>(attr);
+  }
+
+  template <typename D>
+  static void end(handle_type h) noexcept {
+    detail::end<D>(h);
+  }
+};
+
+/**
+ * @brief Backend forwarding events to both `First` and `Second`.
+ *
+ * Events begin in `First` before `Second` and end in the reverse order.
+ */
+template <typename First, typename Second>
+struct both {
+  struct handle_type {
+    typename First::handle_type first;
+    typename Second::handle_type second;
+  };
+  static constexpr bool active{First::active or Second::active};
+
+  template <typename D>
+  static void push(event_attributes const& attr) noexcept {
+    First::template push<D>(attr);
+    Second::template push<D>(attr);
+  }
+
+  template <typename D>
+  static void pop() noexcept {
+    Second::template pop<D>();
+    First::template pop<D>();
+  }
+
+  template <typename D>
+  static void mark(event_attributes const& attr) noexcept {
+    First::template mark<D>(attr);
+    Second::template mark<D>(attr);
+  }
+
+  template <typename D>
+  static handle_type start(event_attributes const& attr) noexcept {
+    auto const first = First::template start<D>(attr);
+    return handle_type{first, Second::template start<D>(attr)};
+  }
+
+  template <typename D>
+  static void end(handle_type h) noexcept {
+    Second::template end<D>(h.second);
+    First::template end<D>(h.first);
+  }
+};
+}  // namespace backend
+
+namespace detail {
+
+/**
+ * @brief The default backend of the domain `D`, `D::backend` if present.
+ *
+ */
+template <typename D, typename = void>
+struct domain_backend {
+  using type = backend::nvtx;
+};
+
+template <typename D>
+struct domain_backend<
+    D, typename std::conditional<false, typename D::backend, void>::type> {
+  using type = typename D::backend;
+};
+
+template <typename D>
+using domain_backend_t = typename domain_backend<D>::type;
+}  // namespace detail
+
+/**
+ * @brief Sets default attributes for the thread ranges and marks of a domain
+ * created on the calling thread during its lifetime.
+ *
+ * While a `scoped_defaults<D>` is alive, every `domain_thread_range<D>` and
+ * `mark<D>` created on the same thread whose attributes omit a category,
+ * color, or payload takes the default one instead. This allows tagging a
+ * whole subsystem, e.g., a background thread, without passing attributes
+ * through every call.
+ *
+ * `scoped_defaults` nest: an inner object inherits the defaults of the
+ * enclosing one that it does not set itself. Defaults apply before the
+ * domain's `event_filter`, so a range given a default category is filtered
+ * by that category. A message given to `scoped_defaults` is ignored, and
+ * events created from an `attr_id` keep their shared attributes unchanged.
+ *
+ * Behavior is undefined if `scoped_defaults` objects of the same domain are
+ * not destroyed in the reverse order of their creation on a thread.
+ *
+ * Example:
+ * \code{.cpp}
+ * void compaction_thread(){
+ *    nvtx3::scoped_defaults<my_domain> tag{nvtx3::category{3},
+ *                                          nvtx3::rgb{0, 0, 255}};
+ *    // Blue and in category 3
+ *    nvtx3::domain_thread_range<my_domain> r{"compact"};
+ *    // Blue and in category 4
+ *    nvtx3::mark<my_domain>(nvtx3::event_attributes{"done",
+ *                                                   nvtx3::category{4}});
+ * }
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain`
+ * whose events receive the defaults. Else, `domain::global` to indicate that
+ * the global NVTX domain should be used.
+ */
+template <typename D = domain::global>
+class scoped_defaults {
+ public:
+  /**
+   * @brief Sets the category, color and payload of `defaults` as the defaults
+   * of the calling thread until destruction.
+   *
+   * @param defaults The default attributes
+   */
+  explicit scoped_defaults(event_attributes const& defaults) noexcept
+      : previous_{current_},
+        defaults_{previous_ == nullptr ? defaults : previous_->apply(defaults)} {
+    current_ = this;
+  }
+
+  /**
+   * @brief Sets defaults from the constructor arguments of an
+   * `event_attributes`.
+   *
+   */
+  template <typename First, typename... Args,
+            typename = typename std::enable_if<not std::is_same<
+                event_attributes, typename std::decay<First>::type>::value>::type>
+  explicit scoped_defaults(First const& first, Args const&... args) noexcept
+      : scoped_defaults{event_attributes{first, args...}} {}
+
+  /**
+   * @brief Restores the defaults in effect before construction.
+   *
+   */
+  ~scoped_defaults() noexcept { current_ = previous_; }
+
+  scoped_defaults(scoped_defaults const&) = delete;
+  scoped_defaults& operator=(scoped_defaults const&) = delete;
+  scoped_defaults(scoped_defaults&&) = delete;
+  scoped_defaults& operator=(scoped_defaults&&) = delete;
+
+  /**
+   * @brief Returns the innermost `scoped_defaults` alive on the calling
+   * thread, or `nullptr` if there is none.
+   *
+   */
+  static scoped_defaults const* current() noexcept { return current_; }
+
+  /**
+   * @brief Returns `attr` with the fields it omits set to the defaults.
+   *
+   * @param attr The attributes of an event
+   */
+  event_attributes apply(event_attributes const& attr) const noexcept {
+    event_attributes merged{attr};
+    auto& m = detail::attributes_access::fields(merged);
+    auto const& d = *defaults_.get();
+    if (m.category == 0) {
+      m.category = d.category;
+    }
+    if (m.colorType == NVTX_COLOR_UNKNOWN) {
+      m.colorType = d.colorType;
+      m.color     = d.color;
+    }
+    if (m.payloadType == NVTX_PAYLOAD_UNKNOWN) {
+      m.payloadType = d.payloadType;
+      m.payload     = d.payload;
+    }
+    return merged;
+  }
+
+ private:
+  static thread_local scoped_defaults const* current_;  ///< Innermost
+                                                        ///< defaults
+
+  scoped_defaults const* const previous_;  ///< Enclosing defaults
+  event_attributes const defaults_;        ///< Defaults, merged with the
+                                           ///< enclosing defaults
+};
+
+template <typename D>
+thread_local scoped_defaults<D> const* scoped_defaults<D>::current_{nullptr};
+
+namespace detail {
+
+/**
+ * @brief Invokes `f` with `attr` merged with the calling thread's
+ * `scoped_defaults` of the domain `D`, if any.
+ *
+ * Avoids copying `attr` when no defaults are set. Attributes from the
+ * `attr_id` registry are passed unchanged so events keep their id.
+ */
+template <typename D, typename F>
+inline auto with_defaults(event_attributes const& attr, F f) noexcept
+    -> decltype(f(attr)) {
+  auto const defaults = scoped_defaults<D>::current();
+  return defaults == nullptr or attribute_id(attr) != 0
+             ? f(attr)
+             : f(defaults->apply(attr));
+}
+}  // namespace detail
+
+template <typename D = domain::global,
+          typename B = detail::domain_backend_t<D>>
+class domain_thread_range;
+
+/**
+ * @brief A RAII object for creating a NVTX range local to a thread within a
+ * domain.
+ *
+ * When constructed, begins a nested NVTX range on the calling thread in the
+ * specified domain. Upon destruction, ends the NVTX range.
+ *
+ * Behavior is undefined if a `domain_thread_range` object is
+ * created/destroyed on different threads.
+ *
+ * `domain_thread_range` is neither moveable nor copyable.
+ *
+ * `domain_thread_range`s may be nested within other ranges.
+ *
+ * The domain of the range is specified by the template type parameter `D`.
+ * By default, the `domain::global` is used, which scopes the range to the
+ * global NVTX domain. The convenience alias `thread_range` is provided for
+ * ranges scoped to the global domain.
+ *
+ * A custom domain can be defined by creating a type, `D`, with a static
+ * member `D::name` whose value is used to name the domain associated with
+ * `D`. `D::name` must resolve to either `char const*` or `wchar_t const*`
+ *
+ * The events of the range are sent to the `backend` `B`, which defaults to
+ * the backend of `D`.
+ *
+ * Example:
+ * ```
+ * // Define a type `my_domain` with a member `name` used to name the domain
+ * // associated with the type `my_domain`.
+ * struct my_domain{
+ *    static constexpr const char * name{"my domain"};
+ * };
+ * ```
+ *
+ * Usage:
+ * ```
+ * nvtx3::domain_thread_range<> r0{"range 0"}; // Range in global domain
+ *
+ * nvtx3::thread_range r1{"range 1"}; // Alias for range in global domain
+ *
+ * nvtx3::domain_thread_range<my_domain> r2{"range 2"}; // Range in custom
+ * domain
+ *
+ * // specify an alias to a range that uses a custom domain
+ * using my_thread_range = nvtx3::domain_thread_range<my_domain>;
+ *
+ * my_thread_range r3{"range 3"}; // Alias for range in custom domain
+ * ```
+ */
+template <class D, class B>
+class domain_thread_range {
+ public:
+  /**
+   * @brief Construct a `domain_thread_range` with the specified
+   * `event_attributes`
+   *
+   * Example:
+   * ```
+   * nvtx3::event_attributes attr{"msg", nvtx3::rgb{127,255,0}};
+   * nvtx3::domain_thread_range<> range{attr}; // Creates a range with message
+   * contents
+   *                                    // "msg" and green color
+   * ```
+   *
+   * @param[in] attr `event_attributes` that describes the desired attributes
+   * of the range.
+   */
+  explicit domain_thread_range(event_attributes const& attr) noexcept
+      : enabled_{B::active and detail::with_defaults<D>(attr, begin)} {}
+
+  /**
+   * @brief Constructs a `domain_thread_range` from the constructor arguments
+   * of an `event_attributes`.
+   *
+   * Forwards the arguments `first, args...` to construct an
+   * `event_attributes` object. The `event_attributes` object is then
+   * associated with the `domain_thread_range`.
+   *
+   * For more detail, see `event_attributes` documentation.
+   *
+   * Example:
+   * ```
+   * // Creates a range with message "message" and green color
+   * nvtx3::domain_thread_range<> r{"message", nvtx3::rgb{127,255,0}};
+   * ```
+   *
+   * @note To prevent making needless copies of `event_attributes` objects,
+   * this constructor is disabled when the first argument is an
+   * `event_attributes` object, instead preferring the explicit
+   * `domain_thread_range(event_attributes const&)` constructor.
+   *
+   * @param[in] first First argument to forward to the `event_attributes`
+   * constructor.
+   * @param[in] args Variadic parameter pack of additional arguments to
+   * forward.
+   *
+   */
+  template <typename First, typename... Args,
+            typename = typename std::enable_if<not std::is_same<
+                event_attributes, typename std::decay<First>>::value>>
+  explicit domain_thread_range(First const& first, Args const&... args) noexcept
+      : domain_thread_range{event_attributes{first, args...}} {}
+
+  /**
+   * @brief Construct a `domain_thread_range` with the shared attributes
+   * identified by `id`.
+   *
+   * Example:
+   * ```
+   * nvtx3::domain_thread_range<my_domain> r{nvtx3::attr_id<my_attrs>{}};
+   * ```
+   *
+   * @param[in] id The `attr_id` of the range's attributes
+   */
+  template <typename T>
+  explicit domain_thread_range(attr_id<T> id) noexcept
+      : domain_thread_range{id.attributes()} {}
+
+  /**
+   * @brief Default constructor creates a `domain_thread_range` with no
+   * message, color, payload, nor category.
+   *
+   */
+  domain_thread_range() : domain_thread_range{event_attributes{}} {}
+
+  domain_thread_range(domain_thread_range const&) = delete;
+  domain_thread_range& operator=(domain_thread_range const&) = delete;
+  domain_thread_range(domain_thread_range&&) = delete;
+  domain_thread_range& operator=(domain_thread_range&&) = delete;
+
+  /**
+   * @brief Destroy the domain_thread_range, ending the NVTX range event.
    */
-  constexpr range_handle(value_type id) noexcept : _range_id{id} {}
+  ~domain_thread_range() noexcept {
+    if (enabled_) {
+      B::template pop<D>();
+    }
+  }
 
+ private:
   /**
-   * @brief Returns the `range_handle`'s value
+   * @brief Begins the range if it passes the domain's `event_filter`,
+   * returning whether it did.
    *
-   * @return value_type The handle's value
    */
-  constexpr value_type get_value() const noexcept { return _range_id; }
+  static bool begin(event_attributes const& attr) noexcept {
+    if (not detail::is_enabled<D>(attr)) {
+      return false;
+    }
+    B::template push<D>(attr);
+    return true;
+  }
 
-private:
-  value_type _range_id{}; ///< The underlying NVTX range id
+  bool const enabled_;  ///< Whether the range passed the domain's
+                        ///< `event_filter` and was pushed
 };
 
+/**
+ * @brief Alias for a `domain_thread_range` in the global NVTX domain.
+ *
+ */
+using thread_range = domain_thread_range<>;
+
 /**
  * @brief Manually begin an NVTX range.
  *
@@ -1802,7 +3428,7 @@ private:
  */
 template <typename D = domain::global>
 range_handle start_range(event_attributes const &attr) noexcept {
-  return range_handle{nvtxDomainRangeStartEx(domain::get<D>(), attr.get())};
+  return detail::nvtx_start<D>(attr);
 }
 
 /**
@@ -1852,7 +3478,9 @@ range_handle start_range(First const &first, Args const &... args) noexcept {
  *
  * @param r Handle to a range started by a prior call to `start_range`.
  */
-void end_range(range_handle r) { nvtxRangeEnd(r.get_value()); }
+inline void end_range(range_handle r) {
+  detail::nvtx_end<domain::global>(r);
+}
 
 /**
  * @brief A RAII object for creating a NVTX range within a domain that can
@@ -1872,8 +3500,12 @@ void end_range(range_handle r) { nvtxRangeEnd(r.get_value()); }
  * @tparam D Type containing `name` member used to identify the `domain`
  * to which the `domain_process_range` belongs. Else, `domain::global` to
  * indicate that the global NVTX domain should be used.
+ * @tparam B The `backend` receiving the range's events. Defaults to the
+ * backend of `D`.
  */
-template <typename D = domain::global> class domain_process_range {
+template <typename D = domain::global,
+          typename B = detail::domain_backend_t<D>>
+class domain_process_range {
  public:
   /**
    * @brief Construct a new domain process range object
@@ -1881,7 +3513,8 @@ template <typename D = domain::global> class domain_process_range {
    * @param attr
    */
   explicit domain_process_range(event_attributes const &attr) noexcept
-      : handle_{start_range(attr)} {}
+      : domain_process_range{attr,
+                             B::active and detail::is_enabled<D>(attr)} {}
 
   /**
    * @brief Construct a new domain process range object
@@ -1896,6 +3529,16 @@ template <typename D = domain::global> class domain_process_range {
                                 Args const &... args) noexcept
       : domain_process_range{event_attributes{first, args...}} {}
 
+  /**
+   * @brief Construct a `domain_process_range` with the shared attributes
+   * identified by `id`.
+   *
+   * @param[in] id The `attr_id` of the range's attributes
+   */
+  template <typename T>
+  explicit domain_process_range(attr_id<T> id) noexcept
+      : domain_process_range{id.attributes()} {}
+
   /**
    * @brief Construct a new domain process range object
    *
@@ -1909,7 +3552,7 @@ template <typename D = domain::global> class domain_process_range {
    */
   ~domain_process_range() noexcept {
     if (not moved_from_) {
-      end_range(handle_);
+      B::template end<D>(handle_);
     }
   }
 
@@ -1920,7 +3563,7 @@ template <typename D = domain::global> class domain_process_range {
    * @param other
    */
   domain_process_range(domain_process_range &&other) noexcept
-      : handle_{other.handle_} {
+      : handle_{other.handle_}, moved_from_{other.moved_from_} {
     other.moved_from_ = true;
   }
 
@@ -1928,12 +3571,22 @@ template <typename D = domain::global> class domain_process_range {
    * @brief Move assignment operator allows taking ownership of an NVTX range
    * from another `domain_process_range`.
    *
+   * Ends the range owned by this object, if any, before taking ownership.
+   *
    * @param other
    * @return domain_process_range&
    */
   domain_process_range &operator=(domain_process_range &&other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+    if (not moved_from_) {
+      B::template end<D>(handle_);
+    }
     handle_ = other.handle_;
+    moved_from_ = other.moved_from_;
     other.moved_from_ = true;
+    return *this;
   }
 
   /// Copy construction is not allowed to prevent multiple objects from owning
@@ -1945,10 +3598,21 @@ template <typename D = domain::global> class domain_process_range {
   domain_process_range &operator=(domain_process_range const &) = delete;
 
  private:
-  range_handle handle_;    ///< Range handle used to correlate
-                            ///< the start/end of the range
-  bool moved_from_{false}; ///< Indicates if the object has had
-                            ///< it's contents moved from it,
+  /**
+   * @brief Starts the range if `enabled`, otherwise constructs an object that
+   * does not own a range.
+   *
+   */
+  domain_process_range(event_attributes const &attr, bool enabled) noexcept
+      : handle_(enabled ? B::template start<D>(attr)
+                        : typename B::handle_type{}),
+        moved_from_{not enabled} {}
+
+  typename B::handle_type handle_;  ///< Range handle used to correlate
+                                    ///< the start/end of the range
+  bool moved_from_{false};  ///< Indicates if the object has had
+                            ///< it's contents moved from it, or was
+                            ///< dropped by the domain's `event_filter`,
                             ///< indicating it should not attempt
                             ///< to end the NVTX range.
 };
@@ -1959,6 +3623,122 @@ template <typename D = domain::global> class domain_process_range {
  */
 using process_range = domain_process_range<>;
 
+namespace detail {
+
+/**
+ * @brief Default callback of a `timed_range`, doing nothing.
+ *
+ */
+struct no_callback {
+  template <typename Duration>
+  void operator()(Duration) const noexcept {}
+};
+}  // namespace detail
+
+/**
+ * @brief A range that also measures its own duration, for use in an
+ * application's own metrics.
+ *
+ * `timed_range` wraps a `domain_thread_range` or `domain_process_range`,
+ * capturing a start timestamp from `Clock` once the range has begun. The
+ * time since then is available from `elapsed()`, and the callable `F`, if
+ * provided, is invoked with the range's total duration when the range ends.
+ * The same boundaries thus feed both NVTX and the application, without a
+ * separate timer around the range.
+ *
+ * The timestamp is taken whether or not the range passed the domain's
+ * `event_filter`. Ranges without a `timed_range` take no timestamp.
+ *
+ * Example:
+ * \code{.cpp}
+ * nvtx3::timed_range<nvtx3::thread_range> r{"load"};
+ * ...
+ * if (r.elapsed() > deadline) { ... }
+ *
+ * // Records the duration of the range in a histogram when it ends
+ * auto record = [&](std::chrono::nanoseconds d){ latencies.add(d); };
+ * nvtx3::timed_range<nvtx3::thread_range, decltype(record)> r2{record,
+ *                                                                "handle"};
+ * \endcode
+ *
+ * @tparam Range The range type, a `domain_thread_range` or
+ * `domain_process_range`
+ * @tparam F Type of the callable invoked with the range's duration when it
+ * ends
+ * @tparam Clock The clock measuring the range, `std::chrono::steady_clock` by
+ * default
+ */
+template <typename Range, typename F = detail::no_callback,
+          typename Clock = std::chrono::steady_clock>
+class timed_range : public Range {
+ public:
+  /// Type of the durations measured
+  using duration = typename Clock::duration;
+
+  /**
+   * @brief Begins a range, forwarding `args...` to the constructor of `Range`,
+   * whose duration is passed to `on_end` when it ends.
+   *
+   * @param on_end Callable invoked with the range's duration when it ends
+   * @param args Arguments forwarded to the constructor of `Range`
+   */
+  template <typename... Args>
+  explicit timed_range(F on_end, Args const&... args) noexcept
+      : Range{args...}, on_end_(std::move(on_end)), start_{Clock::now()} {}
+
+  /**
+   * @brief Begins a range, forwarding `args...` to the constructor of `Range`,
+   * with a default constructed callback.
+   *
+   * Only meaningful if a default constructed `F` is callable, e.g., not for
+   * function pointers.
+   *
+   * @param args Arguments forwarded to the constructor of `Range`
+   */
+  template <typename... Args>
+  explicit timed_range(Args const&... args) noexcept
+      : timed_range{F{}, args...} {}
+
+  /**
+   * @brief Move constructor, for movable `Range`s, transferring the range and
+   * its callback.
+   *
+   */
+  timed_range(timed_range&& other) noexcept
+      : Range{static_cast<Range&&>(other)},
+        on_end_(std::move(other.on_end_)),
+        start_{other.start_},
+        ended_{other.ended_} {
+    other.ended_ = true;
+  }
+
+  timed_range(timed_range const&) = delete;
+  timed_range& operator=(timed_range const&) = delete;
+  timed_range& operator=(timed_range&&) = delete;
+
+  /**
+   * @brief Invokes the callback with the range's duration, then ends the
+   * range.
+   *
+   */
+  ~timed_range() noexcept {
+    if (not ended_) {
+      on_end_(elapsed());
+    }
+  }
+
+  /**
+   * @brief Returns the time elapsed since the range began.
+   *
+   */
+  duration elapsed() const noexcept { return Clock::now() - start_; }
+
+ private:
+  F on_end_;  ///< Invoked with the range's duration when it ends
+  typename Clock::time_point const start_;  ///< When the range began
+  bool ended_{false};  ///< Whether the range was moved from
+};
+
 /**
  * @brief Annotates an instantaneous point in time with the attributes specified
  * by `attr`.
@@ -1977,14 +3757,345 @@ using process_range = domain_process_range<>;
  * @tparam D Type containing `name` member used to identify the `domain`
  * to which the `domain_process_range` belongs. Else, `domain::global` to
  * indicate that the global NVTX domain should be used.
+ * @tparam B The `backend` receiving the mark's events. Defaults to the
+ * backend of `D`.
  * @param[in] attr `event_attributes` that describes the desired attributes
  * of the mark.
  */
-template <typename D = nvtx3::domain::global>
+template <typename D = nvtx3::domain::global,
+          typename B = detail::domain_backend_t<D>>
 inline void mark(event_attributes const& attr) noexcept {
-  nvtxDomainMarkEx(domain::get<D>(), attr.get());
+  if (B::active) {
+    detail::with_defaults<D>(attr, [](event_attributes const& a) {
+      if (detail::is_enabled<D>(a)) {
+        B::template mark<D>(a);
+      }
+    });
+  }
+}
+
+/**
+ * @brief Annotates an instantaneous point in time with the shared attributes
+ * identified by `id`.
+ *
+ * \code{.cpp}
+ * nvtx3::mark<my_domain>(nvtx3::attr_id<my_attrs>{});
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain`
+ * to which the mark belongs. Else, `domain::global` to indicate that the
+ * global NVTX domain should be used.
+ * @tparam B The `backend` receiving the mark. Defaults to the backend of `D`.
+ * @param[in] id The `attr_id` of the mark's attributes
+ */
+template <typename D = nvtx3::domain::global,
+          typename B = detail::domain_backend_t<D>, typename T>
+inline void mark(attr_id<T> id) noexcept {
+  mark<D, B>(id.attributes());
+}
+
+/**
+ * @brief A named throughput marker, e.g., the completion of a request or of a
+ * unit of work.
+ *
+ * Every call to `visit()` emits a `mark` whose message is the progress point's
+ * registered name and whose payload is the number of visits so far, including
+ * this one. The rate of visits is the application's throughput at that point,
+ * which tools, such as causal profilers, can use to measure the effect of
+ * other parts of the program on overall progress.
+ *
+ * The visit count is shared by all threads. Progress points are therefore
+ * intended for places visited once per unit of useful work, not inner loops.
+ *
+ * Similar to `registered_message`, a progress point should be created once and
+ * reused. This can be done by either explicitly creating static
+ * `progress_point` objects, or using the `progress_point::get` construct on
+ * first use helper (recommended).
+ *
+ * Example:
+ * \code{.cpp}
+ * // Define a type with a `message` member naming the progress point
+ * struct request_done{ static constexpr char const* message{"request done"}; };
+ *
+ * void handle_request(){
+ *    ...
+ *    nvtx3::progress_point<my_domain>::get<request_done>().visit();
+ * }
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain` to
+ * which the `progress_point` belongs. Else, `domain::global` to  indicate
+ * that the global NVTX domain should be used.
+ */
+template <typename D = domain::global>
+class progress_point {
+ public:
+  /**
+   * @brief Returns a global instance of a `progress_point` as a function local
+   * static.
+   *
+   * Upon first invocation, constructs a `progress_point` named by the
+   * contents of `M::message`. All future invocations return a reference to
+   * the object constructed in the first invocation.
+   *
+   * @tparam M Type required to contain a member `M::message` that resolves to
+   * either a `char const*` or `wchar_t const*` used as the name of the
+   * progress point.
+   * @return Reference to a `progress_point` associated with the type `M`.
+   */
+  template <typename M>
+  static progress_point<D>& get() noexcept {
+    static progress_point<D> point{M::message};
+    return point;
+  }
+
+  /**
+   * @brief Constructs a `progress_point` named `name`.
+   *
+   * @param name The name of the progress point, registered with NVTX
+   */
+  explicit progress_point(char const* name) noexcept : name_{name} {}
+
+  /**
+   * @brief Constructs a `progress_point` named `name`.
+   *
+   * @param name The name of the progress point, registered with NVTX
+   */
+  explicit progress_point(wchar_t const* name) noexcept : name_{name} {}
+
+  progress_point() = delete;
+  ~progress_point() = default;
+  progress_point(progress_point const&) = delete;
+  progress_point& operator=(progress_point const&) = delete;
+  progress_point(progress_point&&) = delete;
+  progress_point& operator=(progress_point&&) = delete;
+
+  /**
+   * @brief Records one visit of the progress point.
+   *
+   */
+  void visit() noexcept {
+    uint64_t const n{visits_.fetch_add(1, std::memory_order_relaxed) + 1};
+    mark<D>(event_attributes{name_, payload{n}});
+  }
+
+  /**
+   * @brief Returns the number of times the progress point has been visited.
+   *
+   */
+  uint64_t visits() const noexcept {
+    return visits_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  registered_message<D> const name_;  ///< Registered name of the point
+  std::atomic<uint64_t> visits_{0};   ///< Number of visits so far
+};
+
+namespace detail {
+
+/**
+ * @brief Inexpensive monotonic clock used to time scopes locally.
+ *
+ * Reads the time stamp counter once it was calibrated with `calibrate()`,
+ * otherwise `std::chrono::steady_clock` with nanosecond ticks. Calibration is
+ * never performed implicitly, so no event pays for it.
+ */
+struct tick_clock {
+  /**
+   * @brief Returns the current time in ticks.
+   *
+   * @param tsc Whether to read the time stamp counter, which requires
+   * `ticks_per_ns() != 0`, rather than `std::chrono::steady_clock`
+   */
+  static uint64_t now(bool tsc) noexcept {
+#ifdef NVTX3_DETAIL_HAS_TSC
+    if (tsc) {
+      return NVTX3_DETAIL_RDTSC();
+    }
+#else
+    (void)tsc;
+#endif
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  /**
+   * @brief Returns the number of time stamp counter ticks per nanosecond, or
+   * `0` if the counter is not calibrated or not available.
+   *
+   */
+  static double ticks_per_ns() noexcept {
+    return rate().load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Measures the rate of the time stamp counter against
+   * `std::chrono::steady_clock` by spinning for one millisecond.
+   *
+   * @return Whether the time stamp counter is available
+   */
+  static bool calibrate() noexcept {
+#ifdef NVTX3_DETAIL_HAS_TSC
+    auto const t0 = std::chrono::steady_clock::now();
+    uint64_t const c0{NVTX3_DETAIL_RDTSC()};
+    auto t1 = t0;
+    while (t1 - t0 < std::chrono::milliseconds{1}) {
+      t1 = std::chrono::steady_clock::now();
+    }
+    uint64_t const c1{NVTX3_DETAIL_RDTSC()};
+    rate().store(
+        static_cast<double>(c1 - c0) /
+            std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)
+                .count(),
+        std::memory_order_relaxed);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+ private:
+  /// Constant initialized, so reading it requires no guard
+  static std::atomic<double>& rate() noexcept {
+    static std::atomic<double> r{0.0};
+    return r;
+  }
+};
+}  // namespace detail
+
+/**
+ * @brief Calibrates the time stamp counter used by `slow_range`.
+ *
+ * Spins for one millisecond, so it is best called once during startup. Until
+ * then, `slow_range`s time scopes with `std::chrono::steady_clock`, which
+ * costs more per read. Ranges begun after calibration use the time stamp
+ * counter. May be called again at any time, e.g., after a frequency change.
+ *
+ * @return Whether the time stamp counter is available. If not, `slow_range`
+ * keeps using `std::chrono::steady_clock`.
+ */
+inline bool calibrate_tick_clock() noexcept {
+  return detail::tick_clock::calibrate();
 }
 
+/**
+ * @brief A RAII object that annotates a scope only when it runs longer than
+ * a threshold.
+ *
+ * `slow_range` times its own lifetime locally and, upon destruction, emits a
+ * single `mark` in the domain `D` if the lifetime exceeded the threshold.
+ * Scopes faster than the threshold never call into NVTX, making `slow_range`
+ * suitable for always-on outlier detection in hot code paths where a full
+ * range for every invocation would be too expensive.
+ *
+ * The mark is emitted at the end of the scope with the attributes given at
+ * construction, except that its payload is replaced with the scope's
+ * duration in nanoseconds as an unsigned 64-bit integer.
+ *
+ * Timing uses the time stamp counter once `calibrate_tick_clock()` was
+ * called, and `std::chrono::steady_clock` before. Whether the scope is
+ * annotated at all is decided at construction by the domain's
+ * `event_filter`.
+ *
+ * Example:
+ * \code{.cpp}
+ * void handle(request const& r){
+ *    // Marks requests that took longer than 1ms
+ *    nvtx3::slow_range<my_domain> s{std::chrono::milliseconds{1}, "handle"};
+ *    ...
+ * }
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain` to
+ * which the `slow_range` belongs. Else, `domain::global` to indicate that the
+ * global NVTX domain should be used.
+ */
+template <typename D = domain::global>
+class slow_range {
+ public:
+  /**
+   * @brief Begins timing a scope annotated with `attr` if it lasts longer
+   * than `threshold`.
+   *
+   * @param threshold Scopes lasting longer than this are annotated
+   * @param attr `event_attributes` of the mark emitted for slow scopes
+   */
+  template <typename Rep, typename Period>
+  slow_range(std::chrono::duration<Rep, Period> threshold,
+             event_attributes const& attr) noexcept
+      : attributes_{attr},
+        ticks_per_ns_{detail::tick_clock::ticks_per_ns()},
+        threshold_{enabled(attr) ? to_ticks(threshold) : disabled},
+        start_{threshold_ == disabled ? 0 : now()} {}
+
+  /**
+   * @brief Begins timing a scope if it lasts longer than `threshold`,
+   * forwarding `first, args...` to construct its `event_attributes`.
+   *
+   */
+  template <typename Rep, typename Period, typename First, typename... Args,
+            typename = typename std::enable_if<not std::is_same<
+                event_attributes, typename std::decay<First>::type>::value>::type>
+  slow_range(std::chrono::duration<Rep, Period> threshold, First const& first,
+             Args const&... args) noexcept
+      : slow_range{threshold, event_attributes{first, args...}} {}
+
+  slow_range(slow_range const&) = delete;
+  slow_range& operator=(slow_range const&) = delete;
+  slow_range(slow_range&&) = delete;
+  slow_range& operator=(slow_range&&) = delete;
+
+  /**
+   * @brief Emits a mark if the scope lasted longer than the threshold.
+   *
+   */
+  ~slow_range() noexcept {
+    if (threshold_ == disabled) {
+      return;
+    }
+    uint64_t const elapsed{now() - start_};
+    if (elapsed > threshold_) {
+      auto& fields = detail::attributes_access::fields(attributes_);
+      fields.payloadType = NVTX_PAYLOAD_TYPE_UNSIGNED_INT64;
+      fields.payload.ullValue = static_cast<uint64_t>(elapsed / scale());
+      detail::domain_backend_t<D>::template mark<D>(attributes_);
+    }
+  }
+
+ private:
+  /// Threshold value indicating the scope was dropped by the domain's filter
+  static constexpr uint64_t disabled{~uint64_t{0}};
+
+  static bool enabled(event_attributes const& attr) noexcept {
+    return detail::domain_backend_t<D>::active and detail::is_enabled<D>(attr);
+  }
+
+  /// Ticks per nanosecond of the clock timing this scope
+  double scale() const noexcept {
+    return ticks_per_ns_ == 0 ? 1.0 : ticks_per_ns_;
+  }
+
+  uint64_t now() const noexcept {
+    return detail::tick_clock::now(ticks_per_ns_ != 0);
+  }
+
+  template <typename Rep, typename Period>
+  uint64_t to_ticks(std::chrono::duration<Rep, Period> d) const noexcept {
+    auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+    return ns.count() <= 0 ? 0
+                           : static_cast<uint64_t>(ns.count() * scale());
+  }
+
+  event_attributes attributes_;  ///< Attributes of the mark
+  double const ticks_per_ns_;  ///< Rate of the time stamp counter, or `0` to
+                               ///< time with `std::chrono::steady_clock`
+  uint64_t const threshold_;  ///< Threshold in ticks, or `disabled`
+  uint64_t const start_;      ///< Time the scope began in ticks
+};
+
 }  // namespace nvtx3
 
 /**
@@ -2043,3 +4154,51 @@ inline void mark(event_attributes const& attr) noexcept {
  * ```
  */
 #define NVTX3_FUNC_RANGE() NVTX3_FUNC_RANGE_IN(::nvtx3::domain::global)
+
+/**
+ * @brief Convenience macro yielding a `registered_message` in the specified
+ * `domain` for a string literal, registered once per call site.
+ *
+ * Expands to an immediately invoked lambda holding a static
+ * `registered_message` constructed from `literal`. As every lambda has a
+ * distinct type, each use of the macro registers its literal exactly once,
+ * on first execution, giving the performance of a `registered_message`
+ * without defining a tag type for `registered_message::get`.
+ *
+ * `literal` must be a narrow or wide string literal.
+ *
+ * Example:
+ * ```
+ * struct my_domain{static constexpr char const* name{"my_domain"};};
+ *
+ * void foo(){
+ *    nvtx3::domain_thread_range<my_domain> r{
+ *       NVTX3_REGISTERED_MESSAGE_IN(my_domain, "foo"), nvtx3::category{1}};
+ * }
+ * ```
+ *
+ * @param[in] D Type containing `name` member used to identify the
+ * `domain` to which the `registered_message` belongs. Else,
+ * `domain::global` to  indicate that the global NVTX domain should be used.
+ * @param[in] literal The string literal to register
+ */
+#define NVTX3_REGISTERED_MESSAGE_IN(D, literal)                             \
+  ([]() noexcept -> ::nvtx3::registered_message<D> const& {                 \
+    static ::nvtx3::registered_message<D> const nvtx3_detail_literal{       \
+        "" literal};                                                        \
+    return nvtx3_detail_literal;                                            \
+  }())
+
+/**
+ * @brief Convenience macro yielding a `registered_message` in the global
+ * domain for a string literal, registered once per call site.
+ *
+ * Example:
+ * ```
+ * nvtx3::thread_range r{NVTX3_REGISTERED_MESSAGE("foo")};
+ * ```
+ *
+ * @param[in] literal The string literal to register
+ */
+#define NVTX3_REGISTERED_MESSAGE(literal) \
+  NVTX3_REGISTERED_MESSAGE_IN(::nvtx3::domain::global, literal)
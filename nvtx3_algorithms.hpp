@@ -0,0 +1,428 @@
+/*
+ *  Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+#include "nvtx3.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @file nvtx3_algorithms.hpp
+ *
+ * @brief Provides `nvtx3::for_each_chunked` and `nvtx3::transform_reduce`,
+ * algorithms annotating every chunk of work with a range, and the thread pool
+ * running them with `nvtx3::par`.
+ *
+ * Kept separate from `nvtx3.hpp` so that translation units not using the
+ * algorithms neither parse the threading headers nor start a thread pool.
+ */
+
+namespace nvtx3 {
+
+/**
+ * @brief Execution policy running the chunks of `for_each_chunked` and
+ * `transform_reduce` one after another on the calling thread.
+ *
+ */
+struct sequenced_policy {};
+
+/**
+ * @brief Execution policy running the chunks of `for_each_chunked` and
+ * `transform_reduce` concurrently on a built-in thread pool.
+ *
+ */
+struct parallel_policy {
+  /**
+   * @brief Constructs a policy using up to `max_threads` threads, including
+   * the calling thread, or all hardware threads if `0`.
+   *
+   */
+  constexpr explicit parallel_policy(unsigned max_threads = 0) noexcept
+      : threads{max_threads} {}
+
+  unsigned threads;  ///< Maximum number of threads, `0` for all
+};
+
+/// Runs chunks sequentially on the calling thread
+constexpr sequenced_policy seq{};
+
+/// Runs chunks on all hardware threads
+constexpr parallel_policy par{};
+
+namespace detail {
+
+/**
+ * @brief Fixed set of worker threads shared by all parallel algorithms.
+ *
+ * `run` executes a task on a number of workers and the calling thread and
+ * returns once all of them finished it. Concurrent calls are serialized, and
+ * calls made from within a task run on the calling thread alone, so nested
+ * parallel algorithms cannot deadlock.
+ *
+ * Tasks must not throw: an exception escaping a task calls `std::terminate`,
+ * so `run` never returns while a worker may still refer to the task.
+ */
+class thread_pool {
+ public:
+  /**
+   * @brief Returns the process-wide pool, with one worker per hardware thread
+   * besides the calling thread.
+   *
+   */
+  static thread_pool& get() {
+    static thread_pool pool{std::thread::hardware_concurrency()};
+    return pool;
+  }
+
+  explicit thread_pool(unsigned threads) {
+    for (unsigned i = 1; i < threads; ++i) {
+      workers_.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock{mtx_};
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_) {
+      w.join();
+    }
+  }
+
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+
+  /**
+   * @brief Returns the number of threads taking part in `run`, including the
+   * calling thread.
+   *
+   */
+  std::size_t size() const noexcept { return workers_.size() + 1; }
+
+  /**
+   * @brief Runs `task` on `threads - 1` workers and the calling thread.
+   *
+   */
+  void run(std::size_t threads, std::function<void()> const& task) noexcept {
+    if (in_task() or threads <= 1 or workers_.empty()) {
+      task();
+      return;
+    }
+    std::lock_guard<std::mutex> serialize{run_mtx_};
+    {
+      std::lock_guard<std::mutex> lock{mtx_};
+      task_ = &task;
+      active_ = std::min(threads, size()) - 1;
+      pending_ = active_;
+      ++generation_;
+    }
+    wake_.notify_all();
+    execute(task);
+    std::unique_lock<std::mutex> lock{mtx_};
+    done_.wait(lock, [this] { return pending_ == 0; });
+    task_ = nullptr;
+  }
+
+ private:
+  static bool& in_task() noexcept {
+    static thread_local bool flag{false};
+    return flag;
+  }
+
+  /// Marks the calling thread as running a task for its lifetime
+  struct task_scope {
+    task_scope() noexcept { in_task() = true; }
+    ~task_scope() { in_task() = false; }
+    task_scope(task_scope const&) = delete;
+    task_scope& operator=(task_scope const&) = delete;
+  };
+
+  static void execute(std::function<void()> const& task) noexcept {
+    task_scope const scope{};
+    task();
+  }
+
+  void work(std::size_t index) {
+    std::size_t seen{0};
+    for (;;) {
+      std::function<void()> const* task{nullptr};
+      {
+        std::unique_lock<std::mutex> lock{mtx_};
+        wake_.wait(lock, [this, &seen] {
+          return stop_ or generation_ != seen;
+        });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+        if (index > active_) {
+          continue;
+        }
+        task = task_;
+      }
+      execute(*task);
+      {
+        std::lock_guard<std::mutex> lock{mtx_};
+        --pending_;
+      }
+      done_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers_;  ///< The workers
+  std::mutex run_mtx_;                ///< Serializes calls to `run`
+  std::mutex mtx_;                    ///< Protects the members below
+  std::condition_variable wake_;      ///< Signals a new task or `stop_`
+  std::condition_variable done_;      ///< Signals `pending_` reached zero
+  std::function<void()> const* task_{nullptr};  ///< The current task
+  std::size_t active_{0};      ///< Number of workers running the task
+  std::size_t pending_{0};     ///< Workers yet to finish the task
+  std::size_t generation_{0};  ///< Incremented for every task
+  bool stop_{false};           ///< Whether the workers should exit
+};
+
+/**
+ * @brief Invokes `body(c)` for every chunk index `c` in `[0, chunks)` on the
+ * calling thread.
+ *
+ */
+template <typename Body>
+inline void run_chunks(sequenced_policy, std::size_t chunks, Body&& body) {
+  for (std::size_t c = 0; c < chunks; ++c) {
+    body(c);
+  }
+}
+
+/**
+ * @brief Invokes `body(c)` for every chunk index `c` in `[0, chunks)` on the
+ * built-in thread pool, each thread taking the next chunk when done with the
+ * previous one.
+ *
+ */
+template <typename Body>
+inline void run_chunks(parallel_policy policy, std::size_t chunks,
+                       Body&& body) {
+  auto& pool = thread_pool::get();
+  std::size_t threads{policy.threads == 0 ? pool.size() : policy.threads};
+  threads = std::min(threads, chunks);
+  std::atomic<std::size_t> next{0};
+  pool.run(threads, [&next, chunks, &body] {
+    for (std::size_t c = next++; c < chunks; c = next++) {
+      body(c);
+    }
+  });
+}
+
+/**
+ * @brief Returns the payload of the range around the chunk of elements
+ * `[begin, end)`, holding the low 32 bits of `begin` in its upper half and
+ * the low 32 bits of `end` in its lower half.
+ *
+ */
+inline payload chunk_payload(std::size_t begin, std::size_t end) noexcept {
+  return payload{static_cast<uint64_t>(begin & 0xffffffffu) << 32 |
+                 static_cast<uint64_t>(end & 0xffffffffu)};
+}
+
+/**
+ * @brief Holds the result of every chunk of a `transform_reduce` call in a
+ * single allocation.
+ *
+ * Distinct chunks are written concurrently, hence `bool`, stored packed by
+ * `std::vector<bool>`, uses the fallback below.
+ */
+template <typename T,
+          bool = std::is_default_constructible<T>::value and
+                 std::is_move_assignable<T>::value and
+                 not std::is_same<T, bool>::value>
+class chunk_results {
+ public:
+  explicit chunk_results(std::size_t chunks) : results_(chunks) {}
+
+  void set(std::size_t c, T&& value) { results_[c] = std::move(value); }
+  T& operator[](std::size_t c) noexcept { return results_[c]; }
+
+ private:
+  std::vector<T> results_;  ///< The result of every chunk
+};
+
+/**
+ * @brief Holds the result of every chunk of a `transform_reduce` call in its
+ * own allocation, for types that cannot be stored in a `std::vector<T>`
+ * ahead of being computed.
+ *
+ */
+template <typename T>
+class chunk_results<T, false> {
+ public:
+  explicit chunk_results(std::size_t chunks) : results_(chunks) {}
+
+  void set(std::size_t c, T&& value) {
+    results_[c].reset(new T(std::move(value)));
+  }
+  T& operator[](std::size_t c) noexcept { return *results_[c]; }
+
+ private:
+  std::vector<std::unique_ptr<T>> results_;  ///< The result of every chunk
+};
+
+/// Message of the range around a `for_each_chunked` call
+struct for_each_chunked_message {
+  static constexpr char const* message{"for_each_chunked"};
+};
+
+/// Message of the range around a `transform_reduce` call
+struct transform_reduce_message {
+  static constexpr char const* message{"transform_reduce"};
+};
+
+/// Message of the range around a chunk of a parallel algorithm
+struct chunk_message {
+  static constexpr char const* message{"chunk"};
+};
+}  // namespace detail
+
+/**
+ * @brief Applies `f` to every element of `[first, last)`, in chunks of
+ * `chunk` elements, annotating each chunk with a range.
+ *
+ * A thread range named "for_each_chunked" with the number of elements as
+ * payload spans the whole call on the calling thread. Each chunk is processed
+ * within a thread range named "chunk" on the thread processing it. The
+ * payload of a chunk range holds the index of the chunk's first element in
+ * its upper 32 bits and the index one past its last element in its lower 32
+ * bits, both modulo 2^32. Comparing chunk ranges
+ * across threads reveals load imbalance without the cost of annotating every
+ * element.
+ *
+ * With `nvtx3::par`, chunks are distributed dynamically over the built-in
+ * thread pool and `f` must be safe to invoke concurrently. As with the
+ * standard parallel algorithms, an exception escaping `f` calls
+ * `std::terminate`.
+ *
+ * Example:
+ * \code{.cpp}
+ * nvtx3::for_each_chunked<my_domain>(nvtx3::par, v.begin(), v.end(), 4096,
+ *                                    [](float& x){ x = std::sqrt(x); });
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain` to
+ * which the ranges belong. Else, `domain::global` to indicate that the global
+ * NVTX domain should be used.
+ * @param policy `nvtx3::seq` or `nvtx3::par`
+ * @param first,last The random access range of elements
+ * @param chunk Number of elements per chunk, `1` if `0`
+ * @param f Callable applied to every element
+ */
+template <typename D = domain::global, typename Policy, typename It,
+          typename F>
+inline void for_each_chunked(Policy policy, It first, It last,
+                             std::size_t chunk, F f) {
+  auto const n = static_cast<std::size_t>(last - first);
+  domain_thread_range<D> const outer{
+      registered_message<D>::template get<detail::for_each_chunked_message>(),
+      payload{static_cast<uint64_t>(n)}};
+  chunk = std::max<std::size_t>(chunk, 1);
+  detail::run_chunks(policy, (n + chunk - 1) / chunk,
+                     [first, n, chunk, &f](std::size_t c) {
+                       std::size_t const begin{c * chunk};
+                       std::size_t const end{std::min(n, begin + chunk)};
+                       domain_thread_range<D> const r{
+                           registered_message<D>::template get<
+                               detail::chunk_message>(),
+                           detail::chunk_payload(begin, end)};
+                       for (std::size_t i = begin; i < end; ++i) {
+                         f(first[i]);
+                       }
+                     });
+}
+
+/**
+ * @brief Reduces `transform(x)` for every element `x` of `[first, last)` with
+ * `reduce`, in chunks of `chunk` elements, annotating each chunk with a
+ * range.
+ *
+ * Each chunk is reduced in order starting from its first transformed
+ * element, and the results of the chunks are then reduced in order into
+ * `init` on the calling thread. The result is therefore deterministic, and
+ * equals a sequential reduction if `reduce` is associative.
+ *
+ * Ranges are created as for `for_each_chunked`, with the outer range named
+ * "transform_reduce".
+ *
+ * Example:
+ * \code{.cpp}
+ * double sum_of_squares = nvtx3::transform_reduce<my_domain>(
+ *    nvtx3::par, v.begin(), v.end(), 4096, 0.0, std::plus<double>{},
+ *    [](double x){ return x * x; });
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain` to
+ * which the ranges belong. Else, `domain::global` to indicate that the global
+ * NVTX domain should be used.
+ * @param policy `nvtx3::seq` or `nvtx3::par`
+ * @param first,last The random access range of elements
+ * @param chunk Number of elements per chunk, `1` if `0`
+ * @param init Initial value of the reduction
+ * @param reduce Binary callable combining two values
+ * @param transform Unary callable applied to every element
+ * @return The reduction of `init` and all transformed elements
+ */
+template <typename D = domain::global, typename Policy, typename It,
+          typename T, typename Reduce, typename Transform>
+inline T transform_reduce(Policy policy, It first, It last, std::size_t chunk,
+                          T init, Reduce reduce, Transform transform) {
+  auto const n = static_cast<std::size_t>(last - first);
+  domain_thread_range<D> const outer{
+      registered_message<D>::template get<detail::transform_reduce_message>(),
+      payload{static_cast<uint64_t>(n)}};
+  chunk = std::max<std::size_t>(chunk, 1);
+  std::size_t const chunks{(n + chunk - 1) / chunk};
+  detail::chunk_results<T> partial(chunks);
+  detail::run_chunks(
+      policy, chunks,
+      [first, n, chunk, &partial, &reduce, &transform](std::size_t c) {
+        std::size_t const begin{c * chunk};
+        std::size_t const end{std::min(n, begin + chunk)};
+        domain_thread_range<D> const r{
+            registered_message<D>::template get<detail::chunk_message>(),
+            detail::chunk_payload(begin, end)};
+        T acc(transform(first[begin]));
+        for (std::size_t i = begin + 1; i < end; ++i) {
+          acc = reduce(std::move(acc), transform(first[i]));
+        }
+        partial.set(c, std::move(acc));
+      });
+  for (std::size_t c = 0; c < chunks; ++c) {
+    init = reduce(std::move(init), std::move(partial[c]));
+  }
+  return init;
+}
+
+}  // namespace nvtx3
@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+#include "nvtx3.hpp"
+
+#include <future>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @file nvtx3_async.hpp
+ *
+ * @brief Provides `nvtx3::async`, a drop-in replacement for `std::async`
+ * annotating a task's launch, execution and completion with NVTX ranges.
+ *
+ * Kept separate from `nvtx3.hpp` so that translation units not launching
+ * tasks do not pay for parsing `<future>`.
+ */
+
+namespace nvtx3 {
+
+namespace detail {
+
+/**
+ * @brief Callable wrapping a task launched by `nvtx3::async` with the ranges
+ * describing its launch and execution.
+ *
+ */
+template <typename D, typename F>
+class traced_task {
+ public:
+  traced_task(char const* name, F f)
+      : name_{name},
+        f_(std::move(f)),
+        lifetime_{name},
+        delay_{std::string{name} + " (launch delay)"} {}
+
+  template <typename... Args>
+  auto operator()(Args&&... args)
+      -> decltype(std::declval<F&>()(std::forward<Args>(args)...)) {
+    domain_process_range<D> const lifetime{std::move(lifetime_)};
+    { domain_process_range<D> const delay{std::move(delay_)}; }
+    domain_thread_range<D> const execution{name_};
+    return f_(std::forward<Args>(args)...);
+  }
+
+ private:
+  char const* name_;                  ///< Name of the task
+  F f_;                               ///< The task
+  domain_process_range<D> lifetime_;  ///< From launch until ready
+  domain_process_range<D> delay_;     ///< From launch until execution starts
+};
+}  // namespace detail
+
+/**
+ * @brief Runs `f(args...)` like `std::async`, annotating the task's launch,
+ * execution and completion.
+ *
+ * Three ranges named by `name` are created in the domain `D`:
+ * - a process range from the call to `async` until the task completes and
+ *   its result becomes ready in the returned future,
+ * - a process range named "`name` (launch delay)" from the call to `async`
+ *   until the task begins executing, revealing the cost of deferred or
+ *   queued execution,
+ * - a thread range on the thread executing the task for the duration of
+ *   `f(args...)`.
+ *
+ * With `std::launch::deferred`, the task begins executing when the returned
+ * future is first waited on, and the launch delay covers the time until
+ * then. If a deferred task never runs, its ranges end when the future's
+ * shared state is destroyed.
+ *
+ * Example:
+ * \code{.cpp}
+ * auto f = nvtx3::async<my_domain>(std::launch::async, "load", load_file,
+ *                                  path);
+ * ...
+ * auto contents = f.get();
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain` to
+ * which the ranges belong. Else, `domain::global` to indicate that the global
+ * NVTX domain should be used.
+ * @param policy The launch policy, as for `std::async`
+ * @param name Name of the task. Must remain valid until the task begins
+ * executing, e.g., a string literal.
+ * @param f Callable to run
+ * @param args Arguments to invoke `f` with
+ * @return The future holding the result of `f(args...)`
+ */
+template <typename D = domain::global, typename F, typename... Args>
+auto async(std::launch policy, char const* name, F&& f, Args&&... args)
+    -> decltype(std::async(policy, std::forward<F>(f),
+                           std::forward<Args>(args)...)) {
+  return std::async(policy,
+                    detail::traced_task<D, typename std::decay<F>::type>{
+                        name, std::forward<F>(f)},
+                    std::forward<Args>(args)...);
+}
+
+/**
+ * @brief Runs `f(args...)` like `std::async` with the default launch policy,
+ * annotating the task's launch, execution and completion.
+ *
+ * See `async(std::launch, char const*, F&&, Args&&...)`.
+ *
+ */
+template <typename D = domain::global, typename F, typename... Args>
+auto async(char const* name, F&& f, Args&&... args)
+    -> decltype(std::async(std::forward<F>(f), std::forward<Args>(args)...)) {
+  return nvtx3::async<D>(std::launch::async | std::launch::deferred, name,
+                         std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+}  // namespace nvtx3
@@ -0,0 +1,534 @@
+/*
+ *  Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+
+#include "nvtx3.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#define NVTX3_DETAIL_HAS_GETCPU
+#endif
+
+/**
+ * @file nvtx3_migration.hpp
+ *
+ * @brief Provides `nvtx3::migration_tracker`, an observer counting how often
+ * the thread ranges of a domain are migrated between CPUs.
+ *
+ * Kept separate from `nvtx3.hpp` so that translation units not tracking
+ * migrations do not pull in `<sched.h>` and the tracker's tables.
+ */
+
+namespace nvtx3 {
+
+namespace detail {
+
+/**
+ * @brief Returns the CPU the calling thread is running on, or `-1` if it
+ * cannot be determined on this platform.
+ *
+ */
+inline int current_cpu() noexcept {
+#ifdef NVTX3_DETAIL_HAS_GETCPU
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+}  // namespace detail
+
+/**
+ * @brief Migration statistics of the thread ranges sharing a message.
+ *
+ */
+struct migration_stats {
+  std::string name;       ///< The ranges' message, or a description of it
+  uint64_t ranges{0};     ///< Number of ranges that ended
+  uint64_t migrated{0};   ///< Ranges that ended on a different CPU than they
+                          ///< began on
+  uint64_t switches{0};   ///< CPU changes observed during the ranges
+};
+
+/**
+ * @brief An `observer` counting how often the thread ranges of a domain are
+ * migrated between CPUs, by range message.
+ *
+ * The CPU of the calling thread is sampled whenever a thread range of the
+ * domain begins or ends and whenever a mark is emitted. A range that ends on
+ * another CPU than it began on counts as migrated, and every change of CPU
+ * sampled while a range is open counts as a switch for it and the ranges
+ * enclosing it. Switches are thus only observed at event boundaries, so
+ * annotated stages with nested ranges or marks are resolved more finely.
+ *
+ * CPUs are determined with `sched_getcpu`, which is served from user space
+ * on Linux. On other platforms no migrations are detected.
+ *
+ * Ranges are grouped by the handle of their `registered_message`, or by the
+ * text of any other message, so dynamically built strings with equal text
+ * share statistics. Texts are looked up by their hash and told apart by
+ * their first `max_name - 1` characters, to which names are truncated.
+ *
+ * Statistics are kept per thread in fixed-size tables, so the callbacks
+ * never allocate except once per thread, and are merged by `snapshot()`.
+ * Each thread tracks up to `max_messages` distinct messages, ranges with
+ * further messages are counted under the name "(other)", and up to
+ * `max_depth` nested ranges, deeper ones are ignored. When a thread exits,
+ * its statistics are folded into those of exited threads and its state is
+ * released.
+ *
+ * Ranges that were already open when tracking was (re-)enabled are ignored.
+ *
+ * Example:
+ * \code{.cpp}
+ * nvtx3::migration_tracker<my_domain>::get().enable();
+ * ...
+ * for (auto const& s : nvtx3::migration_tracker<my_domain>::get().snapshot()){
+ *    std::cout << s.name << ": " << s.migrated << " of " << s.ranges << '\n';
+ * }
+ * \endcode
+ *
+ * @tparam D Type containing `name` member used to identify the `domain`
+ * whose ranges are tracked. Else, `domain::global` to indicate that the
+ * global NVTX domain should be used.
+ */
+template <typename D = domain::global>
+class migration_tracker final : public observer {
+ public:
+  /// Maximum number of distinct messages tracked per thread
+  static constexpr std::size_t max_messages{64};
+
+  /// Maximum depth of nested ranges tracked per thread
+  static constexpr std::size_t max_depth{64};
+
+  /// Size of the buffer holding the name of a message
+  static constexpr std::size_t max_name{64};
+
+  /**
+   * @brief Returns the tracker of the domain `D`.
+   *
+   */
+  static migration_tracker& get() {
+    static migration_tracker tracker;
+    return tracker;
+  }
+
+  /**
+   * @brief Starts tracking the ranges of `D`.
+   *
+   * Ranges left open on any thread by a previous `disable()` are forgotten.
+   *
+   * @return `true` if tracking is enabled, `false` if the domain has no free
+   * observer slot
+   */
+  bool enable() noexcept {
+    remove_observer<D>(this);
+    epoch_.fetch_add(1, std::memory_order_release);
+    return add_observer<D>(this);
+  }
+
+  /**
+   * @brief Stops tracking the ranges of `D`.
+   *
+   */
+  void disable() noexcept { remove_observer<D>(this); }
+
+  /**
+   * @brief Returns the statistics gathered so far, merged across threads,
+   * one entry per range message.
+   *
+   */
+  std::vector<migration_stats> snapshot() const {
+    std::vector<std::pair<key_type, migration_stats>> merged;
+    auto const add = [&merged](entry const& e) {
+      if (e.ranges.load(std::memory_order_relaxed) == 0) {
+        return;
+      }
+      auto m = merged.begin();
+      while (m != merged.end() and not(m->first == e.key)) {
+        ++m;
+      }
+      if (m == merged.end()) {
+        merged.emplace_back(e.key, migration_stats{});
+        m = merged.end() - 1;
+        m->second.name = e.name;
+      }
+      m->second.ranges += e.ranges.load(std::memory_order_relaxed);
+      m->second.migrated += e.migrated.load(std::memory_order_relaxed);
+      m->second.switches += e.switches.load(std::memory_order_relaxed);
+    };
+    {
+      std::lock_guard<std::mutex> lock{threads_mtx_};
+      retired_.for_each(add);
+      for (auto t = threads_; t != nullptr; t = t->next) {
+        t->stats.for_each(add);
+      }
+    }
+    std::vector<migration_stats> result;
+    result.reserve(merged.size());
+    for (auto& m : merged) {
+      result.push_back(std::move(m.second));
+    }
+    return result;
+  }
+
+  void on_push(event_attributes const& attr) noexcept override {
+    thread_state* const t{local()};
+    if (t == nullptr) {
+      return;
+    }
+    sample(*t);
+    if (t->depth == max_depth) {
+      ++t->overflow;
+      return;
+    }
+    entry& e = t->stats.get(key_of(attr), attributes_name{attr});
+    t->frames[t->depth++] = frame{&e, t->last_cpu, t->switches};
+  }
+
+  void on_pop() noexcept override {
+    thread_state* const t{local()};
+    if (t == nullptr) {
+      return;
+    }
+    sample(*t);
+    if (t->overflow > 0) {
+      --t->overflow;
+      return;
+    }
+    if (t->depth == 0) {
+      return;
+    }
+    frame const& f = t->frames[--t->depth];
+    f.stats->ranges.fetch_add(1, std::memory_order_relaxed);
+    f.stats->migrated.fetch_add(f.cpu != t->last_cpu ? 1 : 0,
+                                std::memory_order_relaxed);
+    f.stats->switches.fetch_add(t->switches - f.switches,
+                                std::memory_order_relaxed);
+  }
+
+  void on_mark(event_attributes const&) noexcept override {
+    if (thread_state* const t = local()) {
+      sample(*t);
+    }
+  }
+
+ private:
+  migration_tracker() = default;
+
+  /// Identifies the message of a range
+  struct key_type {
+    int32_t type;    ///< Message type, text messages are all ASCII
+    uint64_t value;  ///< Handle of a registered message, or hash of the text
+
+    bool operator==(key_type const& other) const noexcept {
+      return type == other.type and value == other.value;
+    }
+  };
+
+  /// Statistics of the ranges sharing a message
+  struct entry {
+    key_type key{NVTX_MESSAGE_UNKNOWN, 0};  ///< The message
+    char name[max_name]{};                  ///< Name of the message
+    std::atomic<uint64_t> ranges{0};        ///< See `migration_stats`
+    std::atomic<uint64_t> migrated{0};      ///< See `migration_stats`
+    std::atomic<uint64_t> switches{0};      ///< See `migration_stats`
+  };
+
+  /**
+   * @brief Statistics by message, only added to by a single thread at a time.
+   *
+   * New entries are published by a release store of `size`, so `snapshot()`
+   * may read them concurrently.
+   */
+  struct stats_table {
+    entry entries[max_messages];  ///< Entries in order of first use
+    entry other;                  ///< Messages beyond `max_messages`
+    std::atomic<std::size_t> size{0};  ///< Number of `entries` in use
+
+    stats_table() noexcept {
+      char const other_name[] = "(other)";
+      for (std::size_t i = 0; i < sizeof(other_name); ++i) {
+        other.name[i] = other_name[i];
+      }
+      other.key = key_type{-1, 0};
+    }
+
+    /**
+     * @brief Returns the entry of `key` and `name`.
+     *
+     * Entries are matched by `key` and by `name.matches(entry.name)`, so
+     * texts whose hashes collide get separate entries. New entries are
+     * named with `name.write(entry.name)`.
+     */
+    template <typename Name>
+    entry& get(key_type const& key, Name const& name) noexcept {
+      std::size_t const n{size.load(std::memory_order_relaxed)};
+      for (std::size_t i = 0; i < n; ++i) {
+        if (entries[i].key == key and name.matches(entries[i].name)) {
+          return entries[i];
+        }
+      }
+      if (key == other.key or n == max_messages) {
+        return other;
+      }
+      entry& e = entries[n];
+      e.key = key;
+      name.write(e.name);
+      size.store(n + 1, std::memory_order_release);
+      return e;
+    }
+
+    /// Invokes `f` with every published entry
+    template <typename F>
+    void for_each(F&& f) const {
+      std::size_t const n{size.load(std::memory_order_acquire)};
+      for (std::size_t i = 0; i < n; ++i) {
+        f(entries[i]);
+      }
+      f(other);
+    }
+  };
+
+  /// A thread range open on a thread
+  struct frame {
+    entry* stats;       ///< Statistics of the range's message
+    int cpu;            ///< CPU the range began on
+    uint64_t switches;  ///< Switches of the thread when the range began
+  };
+
+  /// Statistics and open ranges of a thread
+  struct thread_state {
+    stats_table stats;         ///< Statistics by message
+    frame frames[max_depth];   ///< Open ranges, outermost first
+    std::size_t depth{0};      ///< Number of `frames` in use
+    std::size_t overflow{0};   ///< Open ranges beyond `max_depth`
+    int last_cpu{-1};          ///< Last CPU sampled
+    uint64_t switches{0};      ///< CPU changes sampled so far
+    uint64_t epoch{0};         ///< Value of `epoch_` the frames belong to
+    thread_state* prev{nullptr};  ///< Previous state in `threads_`
+    thread_state* next{nullptr};  ///< Next state in `threads_`
+  };
+
+  /// Owns the state of a thread and retires it when the thread exits
+  struct thread_holder {
+    thread_state* state{nullptr};
+
+    ~thread_holder() {
+      if (state != nullptr) {
+        get().retire(state);
+      }
+    }
+  };
+
+  /**
+   * @brief Returns the state of the calling thread, creating it on first use,
+   * or `nullptr` if it could not be allocated.
+   *
+   */
+  thread_state* local() noexcept {
+    static thread_local thread_holder holder;
+    thread_state* t{holder.state};
+    if (t == nullptr) {
+      t = new (std::nothrow) thread_state{};
+      if (t == nullptr) {
+        return nullptr;
+      }
+      std::lock_guard<std::mutex> lock{threads_mtx_};
+      t->next = threads_;
+      if (threads_ != nullptr) {
+        threads_->prev = t;
+      }
+      threads_ = t;
+      holder.state = t;
+    }
+    uint64_t const epoch{epoch_.load(std::memory_order_acquire)};
+    if (t->epoch != epoch) {
+      t->epoch = epoch;
+      t->depth = 0;
+      t->overflow = 0;
+    }
+    return t;
+  }
+
+  /// Folds the statistics of an exiting thread into `retired_` and frees it
+  void retire(thread_state* t) noexcept {
+    {
+      std::lock_guard<std::mutex> lock{threads_mtx_};
+      t->stats.for_each([this](entry const& e) {
+        entry& r = retired_.get(e.key, stored_name{e.name});
+        r.ranges.fetch_add(e.ranges.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+        r.migrated.fetch_add(e.migrated.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+        r.switches.fetch_add(e.switches.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+      });
+      (t->prev != nullptr ? t->prev->next : threads_) = t->next;
+      if (t->next != nullptr) {
+        t->next->prev = t->prev;
+      }
+    }
+    delete t;
+  }
+
+  static void sample(thread_state& t) noexcept {
+    int const cpu{detail::current_cpu()};
+    if (cpu != t.last_cpu) {
+      if (t.last_cpu != -1) {
+        ++t.switches;
+      }
+      t.last_cpu = cpu;
+    }
+  }
+
+  /// Returns the ASCII character standing for the code point `c`
+  static char to_ascii(uint32_t c) noexcept {
+    return c < 0x80 ? static_cast<char>(c) : '?';
+  }
+
+  /// Returns the FNV-1a hash of `text` as converted by `to_ascii`
+  template <typename Char>
+  static uint64_t hash(Char const* text) noexcept {
+    uint64_t h{14695981039346656037ull};
+    for (; text != nullptr and *text != Char{}; ++text) {
+      h = (h ^ static_cast<unsigned char>(
+                   to_ascii(static_cast<uint32_t>(*text)))) *
+          1099511628211ull;
+    }
+    return h;
+  }
+
+  static key_type key_of(event_attributes const& attr) noexcept {
+    auto const& a = *attr.get();
+    switch (a.messageType) {
+      case NVTX_MESSAGE_TYPE_ASCII:
+        return key_type{NVTX_MESSAGE_TYPE_ASCII, hash(a.message.ascii)};
+      case NVTX_MESSAGE_TYPE_UNICODE:
+        return key_type{NVTX_MESSAGE_TYPE_ASCII, hash(a.message.unicode)};
+      case NVTX_MESSAGE_TYPE_REGISTERED:
+        return key_type{NVTX_MESSAGE_TYPE_REGISTERED,
+                        reinterpret_cast<uintptr_t>(a.message.registered)};
+      default: return key_type{NVTX_MESSAGE_UNKNOWN, 0};
+    }
+  }
+
+  /// Copies `text`, truncated to fit, into `name`
+  template <typename Char>
+  static void copy_name(Char const* text, char* name) noexcept {
+    std::size_t i{0};
+    for (; text != nullptr and text[i] != Char{} and i + 1 < max_name; ++i) {
+      name[i] = to_ascii(static_cast<uint32_t>(text[i]));
+    }
+    name[i] = '\0';
+  }
+
+  /// Returns whether `name` was copied from `text` by `copy_name`
+  template <typename Char>
+  static bool same_name(Char const* text, char const* name) noexcept {
+    std::size_t i{0};
+    for (; text != nullptr and text[i] != Char{} and i + 1 < max_name; ++i) {
+      if (name[i] != to_ascii(static_cast<uint32_t>(text[i]))) {
+        return false;
+      }
+    }
+    return name[i] == '\0';
+  }
+
+  /// Writes the name of the message of `attr` into `name`
+  static void name_of(event_attributes const& attr, char* name) noexcept {
+    auto const& a = *attr.get();
+    switch (a.messageType) {
+      case NVTX_MESSAGE_TYPE_ASCII: copy_name(a.message.ascii, name); break;
+      case NVTX_MESSAGE_TYPE_UNICODE: copy_name(a.message.unicode, name); break;
+      case NVTX_MESSAGE_TYPE_REGISTERED: {
+        char description[] = "registered message 0x0000000000000000";
+        auto value = reinterpret_cast<uintptr_t>(a.message.registered);
+        for (std::size_t i = sizeof(description) - 2; value != 0; --i) {
+          description[i] = "0123456789abcdef"[value % 16];
+          value /= 16;
+        }
+        copy_name(description, name);
+        break;
+      }
+      default: name[0] = '\0'; break;
+    }
+  }
+
+  /// Name of the message of a range's attributes
+  struct attributes_name {
+    event_attributes const& attr;  ///< The range's attributes
+
+    bool matches(char const* name) const noexcept {
+      auto const& a = *attr.get();
+      switch (a.messageType) {
+        case NVTX_MESSAGE_TYPE_ASCII: return same_name(a.message.ascii, name);
+        case NVTX_MESSAGE_TYPE_UNICODE:
+          return same_name(a.message.unicode, name);
+        default: return true;  // Identified by the key alone
+      }
+    }
+
+    void write(char* name) const noexcept { name_of(attr, name); }
+  };
+
+  /// Name stored in an entry of another table
+  struct stored_name {
+    char const* stored;  ///< The stored name
+
+    bool matches(char const* name) const noexcept {
+      for (std::size_t i = 0; i < max_name; ++i) {
+        if (name[i] != stored[i]) {
+          return false;
+        }
+        if (name[i] == '\0') {
+          return true;
+        }
+      }
+      return true;
+    }
+
+    void write(char* name) const noexcept {
+      for (std::size_t i = 0; i < max_name; ++i) {
+        name[i] = stored[i];
+      }
+    }
+  };
+
+  std::atomic<uint64_t> epoch_{0};  ///< Incremented by every `enable()`
+  mutable std::mutex threads_mtx_;  ///< Protects `threads_` and `retired_`
+  thread_state* threads_{nullptr};  ///< States of running threads
+  stats_table retired_;             ///< Statistics of exited threads
+};
+
+template <typename D>
+constexpr std::size_t migration_tracker<D>::max_messages;
+
+template <typename D>
+constexpr std::size_t migration_tracker<D>::max_depth;
+
+template <typename D>
+constexpr std::size_t migration_tracker<D>::max_name;
+
+}  // namespace nvtx3
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file nvtx_ompt.cpp
+ *
+ * @brief OMPT tool that emits NVTX ranges for OpenMP constructs.
+ *
+ * Built as a shared library that OpenMP runtimes supporting OMPT (e.g., LLVM's
+ * libomp) load at startup when it is listed in `OMP_TOOL_LIBRARIES`:
+ *
+ * ```
+ * OMP_TOOL_LIBRARIES=libnvtx3_ompt.so nsys profile ./my_openmp_app
+ * ```
+ *
+ * All ranges are emitted in the "OpenMP" domain:
+ *
+ * | OpenMP construct            | Category          | Payload               |
+ * |-----------------------------|-------------------|-----------------------|
+ * | parallel region             | parallel          | requested threads     |
+ * | implicit task (per thread)  | implicit task     | thread index in team  |
+ * | worksharing loop, sections, | work              | iteration/work count  |
+ * | single, distribute, ...     |                   |                       |
+ * | barrier, taskwait,          | synchronization   |                       |
+ * | taskgroup, reduction        |                   |                       |
+ * | time spent waiting in any   | wait              |                       |
+ * | of the above                |                   |                       |
+ *
+ * Range messages are registered once per construct kind and code location,
+ * and name the function containing the construct as reported by `dladdr`.
+ * Link executables with `-rdynamic` so that their function names can be
+ * resolved, otherwise the code address is used.
+ *
+ * OMPT does not guarantee strict nesting of events across kinds, e.g., a
+ * worker's implicit barrier may end after its implicit task. Therefore,
+ * start/end ranges are used rather than push/pop.
+ */
+
+#include <nvtx3.hpp>
+
+#include <omp-tools.h>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct ompt_domain {
+  static constexpr char const* name{"OpenMP"};
+};
+
+struct parallel_category {
+  static constexpr char const* name{"parallel"};
+  static constexpr nvtx3::category::id_type id{1};
+};
+
+struct implicit_task_category {
+  static constexpr char const* name{"implicit task"};
+  static constexpr nvtx3::category::id_type id{2};
+};
+
+struct work_category {
+  static constexpr char const* name{"work"};
+  static constexpr nvtx3::category::id_type id{3};
+};
+
+struct sync_category {
+  static constexpr char const* name{"synchronization"};
+  static constexpr nvtx3::category::id_type id{4};
+};
+
+struct wait_category {
+  static constexpr char const* name{"wait"};
+  static constexpr nvtx3::category::id_type id{5};
+};
+
+struct implicit_task_message {
+  static constexpr char const* message{"implicit task"};
+};
+
+using category = nvtx3::named_category<ompt_domain>;
+using registered_message = nvtx3::registered_message<ompt_domain>;
+
+/**
+ * @brief Returns the name of the function containing `codeptr`, or its
+ * address if no symbol is found.
+ *
+ */
+std::string symbol_name(void const* codeptr) {
+  Dl_info info{};
+  if (dladdr(codeptr, &info) != 0 and
+      info.dli_sname != nullptr) {
+    int status{};
+    std::unique_ptr<char, void (*)(void*)> demangled{
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status),
+        std::free};
+    return status == 0 ? demangled.get() : info.dli_sname;
+  }
+  char buffer[2 + 2 * sizeof(void*) + 1];
+  std::snprintf(buffer, sizeof(buffer), "%p", codeptr);
+  return buffer;
+}
+
+/**
+ * @brief Key identifying a construct kind at a code location.
+ *
+ */
+using site_key = std::pair<char const*, void const*>;
+
+struct site_key_hash {
+  std::size_t operator()(site_key const& k) const noexcept {
+    return std::hash<void const*>{}(k.first) * 31 +
+           std::hash<void const*>{}(k.second);
+  }
+};
+
+/**
+ * @brief Returns the message registered for the construct `kind` at
+ * `codeptr`, registering it on first use.
+ *
+ * Registered messages are shared by all threads. Each thread caches the ones
+ * it used so that, after warm up, no lock is taken.
+ */
+registered_message const& site_message(char const* kind,
+                                       void const* codeptr) {
+  using map_type =
+      std::unordered_map<site_key, registered_message const*, site_key_hash>;
+  thread_local map_type cache;
+
+  site_key const key{kind, codeptr};
+  auto const cached = cache.find(key);
+  if (cached != cache.end()) {
+    return *cached->second;
+  }
+
+  static std::mutex mtx;
+  static std::unordered_map<site_key, std::unique_ptr<registered_message>,
+                            site_key_hash>
+      registry;
+
+  std::lock_guard<std::mutex> lock{mtx};
+  auto& msg = registry[key];
+  if (not msg) {
+    msg.reset(new registered_message{
+        codeptr == nullptr ? std::string{kind}
+                           : std::string{kind} + " " + symbol_name(codeptr)});
+  }
+  cache.emplace(key, msg.get());
+  return *msg;
+}
+
+/**
+ * @brief Per-thread stacks of open ranges for constructs whose callbacks do
+ * not provide storage for tool data.
+ *
+ */
+struct thread_ranges {
+  std::vector<nvtx3::range_handle> work;
+  std::vector<nvtx3::range_handle> sync;
+  std::vector<nvtx3::range_handle> wait;
+};
+
+thread_ranges& ranges() {
+  thread_local thread_ranges r;
+  return r;
+}
+
+void end_top(std::vector<nvtx3::range_handle>& stack) {
+  if (not stack.empty()) {
+    nvtx3::end_range(stack.back());
+    stack.pop_back();
+  }
+}
+
+char const* work_kind(ompt_work_t wstype) {
+  switch (wstype) {
+    case ompt_work_loop: return "loop";
+    case ompt_work_sections: return "sections";
+    case ompt_work_single_executor: return "single";
+    case ompt_work_single_other: return "single (skipped)";
+    case ompt_work_workshare: return "workshare";
+    case ompt_work_distribute: return "distribute";
+    case ompt_work_taskloop: return "taskloop";
+    default: return "work";
+  }
+}
+
+char const* sync_kind(ompt_sync_region_t kind) {
+  switch (kind) {
+    case ompt_sync_region_taskwait: return "taskwait";
+    case ompt_sync_region_taskgroup: return "taskgroup";
+    case ompt_sync_region_reduction: return "reduction";
+    default: return "barrier";
+  }
+}
+
+void on_parallel_begin(ompt_data_t*, ompt_frame_t const*,
+                       ompt_data_t* parallel_data,
+                       unsigned int requested_parallelism, int,
+                       void const* codeptr_ra) {
+  parallel_data->value =
+      nvtx3::start_range<ompt_domain>(
+          nvtx3::event_attributes{
+              site_message("parallel", codeptr_ra),
+              category::get<parallel_category>(),
+              nvtx3::payload{static_cast<uint32_t>(requested_parallelism)}})
+          .get_value();
+}
+
+void on_parallel_end(ompt_data_t* parallel_data, ompt_data_t*, int,
+                     void const*) {
+  nvtx3::end_range(parallel_data->value);
+}
+
+void on_implicit_task(ompt_scope_endpoint_t endpoint, ompt_data_t*,
+                      ompt_data_t* task_data, unsigned int,
+                      unsigned int index, int flags) {
+  // The initial task spans the whole program, it is not interesting
+  if (flags & ompt_task_initial) {
+    return;
+  }
+  if (endpoint == ompt_scope_begin) {
+    task_data->value =
+        nvtx3::start_range<ompt_domain>(
+            nvtx3::event_attributes{
+                registered_message::get<implicit_task_message>(),
+                category::get<implicit_task_category>(),
+                nvtx3::payload{static_cast<uint32_t>(index)}})
+            .get_value();
+  } else if (endpoint == ompt_scope_end) {
+    nvtx3::end_range(task_data->value);
+  }
+}
+
+void on_work(ompt_work_t wstype, ompt_scope_endpoint_t endpoint, ompt_data_t*,
+             ompt_data_t*, uint64_t count, void const* codeptr_ra) {
+  if (endpoint == ompt_scope_begin) {
+    ranges().work.push_back(nvtx3::start_range<ompt_domain>(
+        nvtx3::event_attributes{site_message(work_kind(wstype), codeptr_ra),
+                                category::get<work_category>(),
+                                nvtx3::payload{count}}));
+  } else if (endpoint == ompt_scope_end) {
+    end_top(ranges().work);
+  }
+}
+
+void on_sync_region(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint,
+                    ompt_data_t*, ompt_data_t*, void const* codeptr_ra) {
+  if (endpoint == ompt_scope_begin) {
+    ranges().sync.push_back(nvtx3::start_range<ompt_domain>(
+        nvtx3::event_attributes{site_message(sync_kind(kind), codeptr_ra),
+                                category::get<sync_category>()}));
+  } else if (endpoint == ompt_scope_end) {
+    end_top(ranges().sync);
+  }
+}
+
+void on_sync_region_wait(ompt_sync_region_t kind,
+                         ompt_scope_endpoint_t endpoint, ompt_data_t*,
+                         ompt_data_t*, void const* codeptr_ra) {
+  if (endpoint == ompt_scope_begin) {
+    ranges().wait.push_back(nvtx3::start_range<ompt_domain>(
+        nvtx3::event_attributes{
+            site_message(kind == ompt_sync_region_taskwait ? "taskwait wait"
+                                                           : "wait",
+                         codeptr_ra),
+            category::get<wait_category>()}));
+  } else if (endpoint == ompt_scope_end) {
+    end_top(ranges().wait);
+  }
+}
+
+int initialize(ompt_function_lookup_t lookup, int, ompt_data_t*) {
+  auto set_callback =
+      reinterpret_cast<ompt_set_callback_t>(lookup("ompt_set_callback"));
+  if (set_callback == nullptr) {
+    return 0;
+  }
+  set_callback(ompt_callback_parallel_begin,
+               reinterpret_cast<ompt_callback_t>(&on_parallel_begin));
+  set_callback(ompt_callback_parallel_end,
+               reinterpret_cast<ompt_callback_t>(&on_parallel_end));
+  set_callback(ompt_callback_implicit_task,
+               reinterpret_cast<ompt_callback_t>(&on_implicit_task));
+  set_callback(ompt_callback_work,
+               reinterpret_cast<ompt_callback_t>(&on_work));
+  set_callback(ompt_callback_sync_region,
+               reinterpret_cast<ompt_callback_t>(&on_sync_region));
+  set_callback(ompt_callback_sync_region_wait,
+               reinterpret_cast<ompt_callback_t>(&on_sync_region_wait));
+  // A non-zero return value keeps the tool active
+  return 1;
+}
+
+void finalize(ompt_data_t*) {}
+
+}  // namespace
+
+/**
+ * @brief Entry point looked up by the OpenMP runtime when loading the tool.
+ *
+ */
+extern "C" ompt_start_tool_result_t* ompt_start_tool(unsigned int,
+                                                     char const*) {
+  static ompt_start_tool_result_t result{&initialize, &finalize, {0}};
+  return &result;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file direct_dispatch_tests.cpp
+ *
+ * @brief Tests that events emitted with `NVTX3_DIRECT_DISPATCH` reach a tool
+ * injected into NVTX.
+ *
+ * Built as its own executable, so CUPTI is attached before this process emits
+ * its first NVTX event, and that first event is in the global domain.
+ */
+
+#include <gtest/gtest.h>
+
+#include <nvtx3.hpp>
+
+#include <cupti.h>
+
+#include <atomic>
+#include <cstdlib>
+
+#ifndef NVTX3_DIRECT_DISPATCH
+#error "direct_dispatch_tests.cpp must be built with NVTX3_DIRECT_DISPATCH"
+#endif
+
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+
+namespace {
+
+/// Number of CUPTI NVTX callbacks received, by callback id
+std::atomic<int> callbacks[CUPTI_CBID_NVTX_nvtxDomainSyncUserReleasing + 1];
+
+void CUPTIAPI count_callback(void*, CUpti_CallbackDomain domain,
+                             CUpti_CallbackId cbid, const void*) {
+  if (domain == CUPTI_CB_DOMAIN_NVTX and
+      cbid <= CUPTI_CBID_NVTX_nvtxDomainSyncUserReleasing) {
+    ++callbacks[cbid];
+  }
+}
+
+/// Injects CUPTI into NVTX before any test emits an event
+struct cupti_environment : ::testing::Environment {
+  void SetUp() override {
+    setenv("NVTX_INJECTION64_PATH", TOSTRING(CUPTI_PATH), 1);
+    CUpti_SubscriberHandle subscriber;
+    cuptiSubscribe(&subscriber, (CUpti_CallbackFunc)count_callback, nullptr);
+    cuptiEnableDomain(1, subscriber, CUPTI_CB_DOMAIN_NVTX);
+  }
+};
+
+::testing::Environment* const environment =
+    ::testing::AddGlobalTestEnvironment(new cupti_environment);
+
+struct dispatch_domain {
+  static constexpr char const* name{"dispatch_domain"};
+};
+
+}  // namespace
+
+// A single test, so its first event is the first of the process regardless
+// of the order tests run in
+TEST(DirectDispatch, EventsReachInjectedTool) {
+  // Obtaining the global domain does not initialize NVTX, the dispatch table
+  // must still not capture the initialization trampolines
+  nvtx3::mark(nvtx3::event_attributes{"global"});
+  auto const& t = nvtx3::detail::dispatch<nvtx3::domain::global>();
+  EXPECT_NE(&NVTX_VERSIONED_IDENTIFIER(nvtxDomainRangePushEx_impl_init),
+            t.push);
+  EXPECT_NE(&NVTX_VERSIONED_IDENTIFIER(nvtxDomainRangePop_impl_init), t.pop);
+  EXPECT_NE(&NVTX_VERSIONED_IDENTIFIER(nvtxDomainMarkEx_impl_init), t.mark);
+  EXPECT_NE(&NVTX_VERSIONED_IDENTIFIER(nvtxDomainRangeStartEx_impl_init),
+            t.start);
+  EXPECT_NE(&NVTX_VERSIONED_IDENTIFIER(nvtxRangeEnd_impl_init), t.end);
+  EXPECT_EQ(1, callbacks[CUPTI_CBID_NVTX_nvtxDomainMarkEx]);
+
+  {
+    nvtx3::domain_thread_range<dispatch_domain> r{"thread"};
+  }
+  EXPECT_EQ(1, callbacks[CUPTI_CBID_NVTX_nvtxDomainRangePushEx]);
+  EXPECT_EQ(1, callbacks[CUPTI_CBID_NVTX_nvtxDomainRangePop]);
+
+  {
+    nvtx3::domain_process_range<dispatch_domain> p{"process"};
+  }
+  EXPECT_EQ(1, callbacks[CUPTI_CBID_NVTX_nvtxDomainRangeStartEx]);
+  EXPECT_EQ(1, callbacks[CUPTI_CBID_NVTX_nvtxRangeEnd]);
+
+  nvtx3::end_range(nvtx3::start_range("global"));
+  EXPECT_EQ(2, callbacks[CUPTI_CBID_NVTX_nvtxDomainRangeStartEx]);
+  EXPECT_EQ(2, callbacks[CUPTI_CBID_NVTX_nvtxRangeEnd]);
+
+  nvtx3::mark<dispatch_domain>(nvtx3::event_attributes{"mark"});
+  EXPECT_EQ(2, callbacks[CUPTI_CBID_NVTX_nvtxDomainMarkEx]);
+}
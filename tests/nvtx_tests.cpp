@@ -18,11 +18,20 @@
 
 #include <nvToolsExtSync.h>
 #include <nvtx3.hpp>
+#include <nvtx3_algorithms.hpp>
+#include <nvtx3_async.hpp>
+#include <nvtx3_migration.hpp>
 
 #include <cupti.h>
 #include <generated_nvtx_meta.h>
 
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
@@ -196,4 +205,583 @@ struct NVTX_Test : public ::testing::Test {
 TEST_F(NVTX_Test, first) {
   nvtxRangePushA("test");
   nvtxRangePop();
-}
\ No newline at end of file
+}
+TEST(EventFilter, EnableDisable) {
+  nvtx3::event_filter f{};
+  EXPECT_FALSE(f.is_enabled(1));
+  f.enable(1).enable(nvtx3::category{42});
+  EXPECT_TRUE(f.is_enabled(1));
+  EXPECT_TRUE(f.is_enabled(42));
+  EXPECT_FALSE(f.is_enabled(2));
+  f.disable(1);
+  EXPECT_FALSE(f.is_enabled(1));
+  EXPECT_FALSE(f.is_enabled(nvtx3::event_filter::capacity + 1));
+  f.enable_overflow();
+  EXPECT_TRUE(f.is_enabled(nvtx3::event_filter::capacity + 1));
+}
+
+struct observer_domain {
+  static constexpr char const* name{"observer"};
+};
+
+struct counting_observer : nvtx3::observer {
+  void on_push(nvtx3::event_attributes const&) noexcept override { ++pushes; }
+  void on_pop() noexcept override { ++pops; }
+  void on_mark(nvtx3::event_attributes const&) noexcept override { ++marks; }
+  void on_start(nvtx3::event_attributes const&,
+                nvtx3::range_handle h) noexcept override {
+    started = h;
+    ++starts;
+  }
+  void on_end(nvtx3::range_handle h) noexcept override {
+    ended = h;
+    ++ends;
+  }
+
+  int pushes{0};
+  int pops{0};
+  int marks{0};
+  int starts{0};
+  int ends{0};
+  nvtx3::range_handle started{0};
+  nvtx3::range_handle ended{0};
+};
+
+/// An event seen by a `recording_observer`
+struct recorded_event {
+  nvtxEventAttributes_t attributes;  ///< Attributes of the event
+  std::string message;               ///< ASCII message, if any
+};
+
+struct recording_observer : nvtx3::observer {
+  void on_push(nvtx3::event_attributes const& attr) noexcept override {
+    std::lock_guard<std::mutex> lock{mtx};
+    pushes.push_back(record(attr));
+  }
+  void on_pop() noexcept override {
+    std::lock_guard<std::mutex> lock{mtx};
+    ++pops;
+  }
+  void on_mark(nvtx3::event_attributes const& attr) noexcept override {
+    std::lock_guard<std::mutex> lock{mtx};
+    marks.push_back(record(attr));
+  }
+  void on_start(nvtx3::event_attributes const& attr,
+                nvtx3::range_handle) noexcept override {
+    std::lock_guard<std::mutex> lock{mtx};
+    starts.push_back(record(attr));
+  }
+  void on_end(nvtx3::range_handle) noexcept override {
+    std::lock_guard<std::mutex> lock{mtx};
+    ++ends;
+  }
+
+  static recorded_event record(nvtx3::event_attributes const& attr) {
+    auto const& a = *attr.get();
+    return recorded_event{a, a.messageType == NVTX_MESSAGE_TYPE_ASCII
+                                 ? std::string{a.message.ascii}
+                                 : std::string{}};
+  }
+
+  std::mutex mtx;
+  std::vector<recorded_event> pushes;
+  std::vector<recorded_event> marks;
+  std::vector<recorded_event> starts;
+  int pops{0};
+  int ends{0};
+};
+
+struct filter_test_domain {
+  static constexpr char const *name{"filter_test_domain"};
+};
+
+TEST_F(NVTX_Test, SetFilter) {
+  static nvtx3::event_filter const f = nvtx3::event_filter{}.enable(1);
+  counting_observer o;
+  EXPECT_TRUE(nvtx3::add_observer<filter_test_domain>(&o));
+  EXPECT_EQ(nullptr, nvtx3::set_filter<filter_test_domain>(&f));
+  {
+    nvtx3::domain_thread_range<filter_test_domain> enabled{nvtx3::category{1}};
+    nvtx3::domain_thread_range<filter_test_domain> dropped{nvtx3::category{2}};
+    nvtx3::mark<filter_test_domain>(nvtx3::event_attributes{nvtx3::category{2}});
+  }
+  EXPECT_EQ(1, o.pushes);
+  EXPECT_EQ(1, o.pops);
+  EXPECT_EQ(0, o.marks);
+
+  EXPECT_EQ(&f, nvtx3::set_filter<filter_test_domain>(nullptr));
+  {
+    nvtx3::domain_thread_range<filter_test_domain> restored{nvtx3::category{2}};
+    nvtx3::mark<filter_test_domain>(nvtx3::event_attributes{nvtx3::category{2}});
+  }
+  EXPECT_EQ(2, o.pushes);
+  EXPECT_EQ(2, o.pops);
+  EXPECT_EQ(1, o.marks);
+  EXPECT_TRUE(nvtx3::remove_observer<filter_test_domain>(&o));
+}
+
+struct test_progress_point {
+  static constexpr char const *message{"test progress point"};
+};
+
+struct progress_domain {
+  static constexpr char const *name{"progress_domain"};
+};
+
+TEST_F(NVTX_Test, ProgressPoint) {
+  auto &p = nvtx3::progress_point<progress_domain>::get<test_progress_point>();
+  recording_observer o;
+  EXPECT_TRUE(nvtx3::add_observer<progress_domain>(&o));
+  auto const before = p.visits();
+  p.visit();
+  p.visit();
+  EXPECT_TRUE(nvtx3::remove_observer<progress_domain>(&o));
+  EXPECT_EQ(before + 2, p.visits());
+  EXPECT_EQ(&p,
+            &nvtx3::progress_point<progress_domain>::get<test_progress_point>());
+
+  ASSERT_EQ(2u, o.marks.size());
+  for (uint64_t i = 0; i < 2; ++i) {
+    auto const &a = o.marks[i].attributes;
+    EXPECT_EQ(NVTX_MESSAGE_TYPE_REGISTERED, a.messageType);
+    EXPECT_EQ(NVTX_PAYLOAD_TYPE_UNSIGNED_INT64, a.payloadType);
+    EXPECT_EQ(before + i + 1, a.payload.ullValue);
+  }
+}
+
+struct fiber_test_domain {
+  static constexpr char const *name{"fiber_test_domain"};
+};
+
+TEST_F(NVTX_Test, FiberContext) {
+  using context = nvtx3::fiber_context<fiber_test_domain>;
+  using range = nvtx3::domain_thread_range<fiber_test_domain>;
+  nvtx3::registered_message<fiber_test_domain> const b0_message{"b0"};
+  context a, b{1};
+  context::switch_to(&a);
+  {
+    range a0{"a0"};
+    EXPECT_EQ(1u, a.depth());
+    EXPECT_EQ(1u, a.dropped_messages());
+    context::switch_to(&b);
+    EXPECT_EQ(&b, context::current());
+    {
+      range b0{b0_message};
+      range b1{nvtx3::category{1}};
+      EXPECT_EQ(2u, b.depth());
+      EXPECT_EQ(0u, b.dropped_messages());
+      context::switch_to(&a);
+      EXPECT_EQ(1u, a.depth());
+      context::switch_to(&b);
+      EXPECT_EQ(2u, b.depth());
+    }
+    EXPECT_EQ(0u, b.depth());
+    context::switch_to(&a);
+  }
+  EXPECT_EQ(0u, a.depth());
+  context::switch_to(nullptr);
+  EXPECT_EQ(nullptr, context::current());
+}
+
+struct async_domain {
+  static constexpr char const *name{"async_domain"};
+};
+
+TEST_F(NVTX_Test, Async) {
+  recording_observer o;
+  EXPECT_TRUE(nvtx3::add_observer<async_domain>(&o));
+  auto sum = nvtx3::async<async_domain>(
+      std::launch::async, "sum", [](int a, int b) { return a + b; }, 1, 2);
+  EXPECT_EQ(3, sum.get());
+
+  auto deferred = nvtx3::async<async_domain>(
+      std::launch::deferred, "deferred",
+      [](std::unique_ptr<int> p) { return *p; },
+      std::unique_ptr<int>{new int{42}});
+  {
+    std::lock_guard<std::mutex> lock{o.mtx};
+    EXPECT_EQ(4u, o.starts.size());
+    EXPECT_EQ(1u, o.pushes.size());
+  }
+  EXPECT_EQ(42, deferred.get());
+
+  auto throws =
+      nvtx3::async<async_domain>("throws", []() -> int { throw 1; });
+  EXPECT_THROW(throws.get(), int);
+  EXPECT_TRUE(nvtx3::remove_observer<async_domain>(&o));
+
+  // Lifetime and launch delay process ranges, and the execution thread range
+  std::vector<std::string> const names{"sum", "deferred", "throws"};
+  ASSERT_EQ(6u, o.starts.size());
+  ASSERT_EQ(3u, o.pushes.size());
+  for (std::size_t i = 0; i < names.size(); ++i) {
+    EXPECT_EQ(names[i], o.starts[2 * i].message);
+    EXPECT_EQ(names[i] + " (launch delay)", o.starts[2 * i + 1].message);
+    EXPECT_EQ(names[i], o.pushes[i].message);
+  }
+  EXPECT_EQ(6, o.ends);
+  EXPECT_EQ(3, o.pops);
+}
+
+struct slow_domain {
+  static constexpr char const *name{"slow_domain"};
+};
+
+TEST_F(NVTX_Test, SlowRange) {
+  recording_observer o;
+  EXPECT_TRUE(nvtx3::add_observer<slow_domain>(&o));
+  auto const threshold = std::chrono::microseconds{1};
+  auto const sleep = std::chrono::milliseconds{1};
+  auto const expect_slow_mark = [&](char const *name) {
+    ASSERT_EQ(1u, o.marks.size());
+    auto const &mark = o.marks.back();
+    EXPECT_EQ(name, mark.message);
+    EXPECT_EQ(NVTX_PAYLOAD_TYPE_UNSIGNED_INT64, mark.attributes.payloadType);
+    EXPECT_GE(mark.attributes.payload.ullValue,
+              static_cast<uint64_t>(
+                  std::chrono::nanoseconds{threshold}.count()));
+    // Allows for the error of the time stamp counter's calibration
+    EXPECT_GE(mark.attributes.payload.ullValue,
+              static_cast<uint64_t>(
+                  std::chrono::nanoseconds{sleep}.count() * 9 / 10));
+    o.marks.clear();
+  };
+
+  {
+    nvtx3::slow_range<slow_domain> fast{std::chrono::seconds{1}, "fast"};
+  }
+  EXPECT_TRUE(o.marks.empty());
+  {
+    nvtx3::slow_range<slow_domain> slow{threshold, "slow", nvtx3::category{1}};
+    std::this_thread::sleep_for(sleep);
+  }
+  expect_slow_mark("slow");
+
+  if (nvtx3::calibrate_tick_clock()) {
+    EXPECT_GT(nvtx3::detail::tick_clock::ticks_per_ns(), 0.0);
+  }
+  {
+    nvtx3::slow_range<slow_domain> fast{std::chrono::seconds{1}, "fast"};
+  }
+  EXPECT_TRUE(o.marks.empty());
+  {
+    nvtx3::slow_range<slow_domain> slow{threshold, "calibrated"};
+    std::this_thread::sleep_for(sleep);
+  }
+  expect_slow_mark("calibrated");
+  EXPECT_TRUE(nvtx3::remove_observer<slow_domain>(&o));
+}
+
+TEST(Observer, ObservesDomainEvents) {
+  counting_observer o;
+  nvtx3::set_nvtx_enabled<observer_domain>(false);
+  EXPECT_TRUE(nvtx3::add_observer<observer_domain>(&o));
+  {
+    nvtx3::domain_thread_range<observer_domain> r{"thread"};
+    nvtx3::domain_process_range<observer_domain> p{"process"};
+    nvtx3::mark<observer_domain>(nvtx3::event_attributes{"mark"});
+    nvtx3::thread_range unobserved{"global"};
+  }
+  EXPECT_TRUE(nvtx3::remove_observer<observer_domain>(&o));
+  EXPECT_FALSE(nvtx3::remove_observer<observer_domain>(&o));
+  nvtx3::set_nvtx_enabled<observer_domain>(true);
+
+  EXPECT_EQ(1, o.pushes);
+  EXPECT_EQ(1, o.pops);
+  EXPECT_EQ(1, o.marks);
+  EXPECT_NE(0u, o.started.get_value());
+  EXPECT_EQ(o.started.get_value(), o.ended.get_value());
+}
+
+TEST(Observer, ProcessRangeMoveAssignment) {
+  using range = nvtx3::domain_process_range<observer_domain>;
+  counting_observer o;
+  nvtx3::set_nvtx_enabled<observer_domain>(false);
+  EXPECT_TRUE(nvtx3::add_observer<observer_domain>(&o));
+  {
+    range a{"a"};
+    range b{"b"};
+    a = std::move(b);
+    EXPECT_EQ(2, o.starts);
+    EXPECT_EQ(1, o.ends);
+    range& self = a;
+    a = std::move(self);
+    EXPECT_EQ(1, o.ends);
+  }
+  EXPECT_TRUE(nvtx3::remove_observer<observer_domain>(&o));
+  nvtx3::set_nvtx_enabled<observer_domain>(true);
+  EXPECT_EQ(2, o.starts);
+  EXPECT_EQ(2, o.ends);
+}
+
+struct counting_backend : nvtx3::backend::base {
+  template <typename D>
+  static void push(nvtx3::event_attributes const&) noexcept {
+    ++events;
+  }
+
+  template <typename D>
+  static void pop() noexcept {
+    ++events;
+  }
+
+  template <typename D>
+  static void mark(nvtx3::event_attributes const&) noexcept {
+    ++events;
+  }
+
+  static thread_local int events;
+};
+
+thread_local int counting_backend::events{0};
+
+struct backend_domain {
+  static constexpr char const* name{"backend"};
+  using backend = nvtx3::backend::both<nvtx3::backend::nvtx, counting_backend>;
+};
+
+struct disabled_domain {
+  static constexpr char const* name{"disabled"};
+  using backend = nvtx3::backend::none;
+};
+
+TEST(Backend, DomainBackend) {
+  {
+    nvtx3::domain_thread_range<backend_domain> r{"range"};
+    nvtx3::domain_process_range<backend_domain> p{"process"};
+    nvtx3::mark<backend_domain>(nvtx3::event_attributes{"mark"});
+    nvtx3::domain_thread_range<disabled_domain> disabled{"disabled"};
+  }
+  EXPECT_EQ(3, counting_backend::events);
+  {
+    nvtx3::domain_thread_range<disabled_domain, counting_backend> r{"range"};
+  }
+  EXPECT_EQ(5, counting_backend::events);
+}
+
+TEST_F(NVTX_Test, RegisteredMessageMacro) {
+  auto site = [] { return &NVTX3_REGISTERED_MESSAGE("literal"); };
+  EXPECT_EQ(site(), site());
+  EXPECT_NE(site(), &NVTX3_REGISTERED_MESSAGE("literal"));
+  nvtx3::thread_range r{NVTX3_REGISTERED_MESSAGE("literal"),
+                        nvtx3::category{1}};
+  nvtx3::domain_thread_range<observer_domain> wide{
+      NVTX3_REGISTERED_MESSAGE_IN(observer_domain, L"wide")};
+}
+
+struct defaults_domain {
+  static constexpr char const* name{"defaults"};
+};
+
+TEST_F(NVTX_Test, ScopedDefaults) {
+  EXPECT_EQ(nullptr, nvtx3::scoped_defaults<defaults_domain>::current());
+  {
+    nvtx3::scoped_defaults<defaults_domain> outer{nvtx3::category{3},
+                                                  nvtx3::rgb{0, 0, 255}};
+    nvtx3::scoped_defaults<defaults_domain> inner{nvtx3::payload{7}};
+    auto const applied = inner.apply(nvtx3::event_attributes{"range"});
+    EXPECT_EQ(3u, applied.get()->category);
+    EXPECT_EQ(NVTX_COLOR_ARGB, applied.get()->colorType);
+    EXPECT_EQ(7, applied.get()->payload.iValue);
+
+    auto const own = inner.apply(nvtx3::event_attributes{nvtx3::category{4}});
+    EXPECT_EQ(4u, own.get()->category);
+
+    nvtx3::domain_thread_range<defaults_domain> r{"range"};
+    nvtx3::mark<defaults_domain>(nvtx3::event_attributes{"mark"});
+  }
+  EXPECT_EQ(nullptr, nvtx3::scoped_defaults<defaults_domain>::current());
+}
+
+struct shared_attributes {
+  static nvtx3::event_attributes attributes() {
+    return nvtx3::event_attributes{"shared", nvtx3::category{2}};
+  }
+};
+
+TEST_F(NVTX_Test, AttributeRegistry) {
+  using id = nvtx3::attr_id<shared_attributes>;
+  EXPECT_NE(0u, id::value());
+  EXPECT_EQ(&id::attributes(), nvtx3::find_attributes(id::value()));
+  EXPECT_EQ(id::value(), nvtx3::attribute_id(id::attributes()));
+  EXPECT_EQ(2u, id::attributes().get()->category);
+
+  nvtx3::event_attributes const local{"local"};
+  EXPECT_EQ(0u, nvtx3::attribute_id(local));
+  EXPECT_EQ(nullptr, nvtx3::find_attributes(0));
+
+  nvtx3::thread_range r{id{}};
+  nvtx3::process_range p{id{}};
+  nvtx3::mark(id{});
+
+  struct id_observer : nvtx3::observer {
+    void on_push(nvtx3::event_attributes const& attr) noexcept override {
+      pushed = nvtx3::attribute_id(attr);
+    }
+    uint32_t pushed{0};
+  } o;
+  EXPECT_TRUE(nvtx3::add_observer<defaults_domain>(&o));
+  {
+    nvtx3::scoped_defaults<defaults_domain> tag{nvtx3::rgb{0, 0, 255}};
+    nvtx3::domain_thread_range<defaults_domain> shared{id{}};
+  }
+  EXPECT_TRUE(nvtx3::remove_observer<defaults_domain>(&o));
+  EXPECT_EQ(id::value(), o.pushed);
+}
+
+TEST_F(NVTX_Test, TimedRange) {
+  std::chrono::nanoseconds recorded{0};
+  auto record = [&recorded](std::chrono::steady_clock::duration d) {
+    recorded = d;
+  };
+  {
+    nvtx3::timed_range<nvtx3::thread_range, decltype(record)> r{
+        record, "timed", nvtx3::category{1}};
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    EXPECT_GE(r.elapsed(), std::chrono::milliseconds{1});
+  }
+  EXPECT_GE(recorded, std::chrono::milliseconds{1});
+
+  int calls{0};
+  auto count = [&calls](std::chrono::steady_clock::duration) { ++calls; };
+  {
+    nvtx3::timed_range<nvtx3::process_range, decltype(count)> p{count,
+                                                                "timed"};
+    auto moved = std::move(p);
+  }
+  EXPECT_EQ(1, calls);
+
+  nvtx3::timed_range<nvtx3::thread_range> untimed{"untimed"};
+  EXPECT_GE(untimed.elapsed().count(), 0);
+}
+
+TEST_F(NVTX_Test, ChunkedAlgorithms) {
+  std::vector<int> v(1000);
+  std::iota(v.begin(), v.end(), 0);
+
+  nvtx3::for_each_chunked(nvtx3::par, v.begin(), v.end(), 64,
+                          [](int& x) { x *= 2; });
+  EXPECT_EQ(2 * 999, v.back());
+
+  auto const sum = nvtx3::transform_reduce(
+      nvtx3::par, v.begin(), v.end(), 100, 0L, std::plus<long>{},
+      [](int x) { return static_cast<long>(x) / 2; });
+  EXPECT_EQ(999L * 1000 / 2, sum);
+
+  auto const seq_sum = nvtx3::transform_reduce(
+      nvtx3::seq, v.begin(), v.end(), 0, 1L, std::plus<long>{},
+      [](int x) { return static_cast<long>(x) / 2; });
+  EXPECT_EQ(sum + 1, seq_sum);
+
+  std::atomic<int> nested{0};
+  nvtx3::for_each_chunked(nvtx3::parallel_policy{2}, v.begin(),
+                          v.begin() + 4, 1, [&nested, &v](int) {
+                            nvtx3::for_each_chunked(
+                                nvtx3::par, v.begin(), v.begin() + 10, 3,
+                                [&nested](int) { ++nested; });
+                          });
+  EXPECT_EQ(40, nested.load());
+}
+
+struct chunk_domain {
+  static constexpr char const *name{"chunk_domain"};
+};
+
+struct no_default_sum {
+  explicit no_default_sum(long v) : value{v} {}
+  long value;
+};
+
+TEST_F(NVTX_Test, ChunkedAlgorithmsPayloads) {
+  std::vector<int> v(10, 1);
+  recording_observer o;
+  EXPECT_TRUE(nvtx3::add_observer<chunk_domain>(&o));
+  nvtx3::for_each_chunked<chunk_domain>(nvtx3::seq, v.begin(), v.end(), 4,
+                                        [](int &) {});
+  auto const sum = nvtx3::transform_reduce<chunk_domain>(
+      nvtx3::par, v.begin(), v.end(), 3, no_default_sum{0},
+      [](no_default_sum a, no_default_sum b) {
+        return no_default_sum{a.value + b.value};
+      },
+      [](int x) { return no_default_sum{x}; });
+  EXPECT_TRUE(nvtx3::remove_observer<chunk_domain>(&o));
+  EXPECT_EQ(10, sum.value);
+
+  // Outer range and 3 chunks, then outer range and 4 chunks
+  ASSERT_EQ(9u, o.pushes.size());
+  EXPECT_EQ(9, o.pops);
+  EXPECT_EQ(10u, o.pushes[0].attributes.payload.ullValue);
+  uint64_t const expected[]{4, uint64_t{4} << 32 | 8,
+                            uint64_t{8} << 32 | 10};
+  for (std::size_t i = 0; i < 3; ++i) {
+    auto const &a = o.pushes[i + 1].attributes;
+    EXPECT_EQ(NVTX_PAYLOAD_TYPE_UNSIGNED_INT64, a.payloadType);
+    EXPECT_EQ(expected[i], a.payload.ullValue);
+  }
+}
+
+TEST(EventAttributes, SinglePassConstruction) {
+  constexpr nvtx3::event_attributes attr{nvtx3::category{1},
+                                         nvtx3::rgb{1, 2, 3}};
+  static_assert(attr.get()->category == 1, "category must be set");
+  static_assert(attr.get()->colorType == NVTX_COLOR_ARGB, "color must be set");
+  static_assert(
+      not std::is_constructible<nvtx3::event_attributes, std::string&&>::value,
+      "temporary strings must be rejected");
+
+  nvtx3::event_attributes const all{nvtx3::payload{42}, "message",
+                                    nvtx3::category{2}, nvtx3::rgb{1, 2, 3}};
+  EXPECT_EQ(2u, all.get()->category);
+  EXPECT_EQ(42, all.get()->payload.iValue);
+  EXPECT_EQ(NVTX_PAYLOAD_TYPE_INT32, all.get()->payloadType);
+  EXPECT_EQ(NVTX_MESSAGE_TYPE_ASCII, all.get()->messageType);
+  EXPECT_STREQ("message", all.get()->message.ascii);
+}
+
+struct migration_domain {
+  static constexpr char const* name{"migration"};
+};
+
+TEST_F(NVTX_Test, MigrationTracker) {
+  auto& tracker = nvtx3::migration_tracker<migration_domain>::get();
+  ASSERT_TRUE(tracker.enable());
+  auto work = [] {
+    for (int i = 0; i < 10; ++i) {
+      nvtx3::domain_thread_range<migration_domain> outer{"outer"};
+      nvtx3::domain_thread_range<migration_domain> inner{"inner"};
+      nvtx3::mark<migration_domain>(nvtx3::event_attributes{"mark"});
+    }
+  };
+  std::thread other{work};
+  work();
+  other.join();
+  tracker.disable();
+
+  auto const stats = tracker.snapshot();
+  ASSERT_EQ(2u, stats.size());
+  for (auto const& s : stats) {
+    EXPECT_TRUE(s.name == "outer" or s.name == "inner");
+    EXPECT_EQ(20u, s.ranges);
+    EXPECT_LE(s.migrated, s.ranges);
+  }
+
+  ASSERT_TRUE(tracker.enable());
+  {
+    std::string const first{"dynamic"};
+    std::string const second{first};
+    nvtx3::domain_thread_range<migration_domain> r0{first.c_str()};
+    nvtx3::domain_thread_range<migration_domain> r1{second.c_str()};
+  }
+  {
+    nvtx3::domain_thread_range<migration_domain> stale{"stale"};
+    tracker.disable();
+    ASSERT_TRUE(tracker.enable());
+  }
+  tracker.disable();
+
+  auto const more = tracker.snapshot();
+  ASSERT_EQ(3u, more.size());
+  for (auto const& s : more) {
+    EXPECT_EQ(s.name == "dynamic" ? 2u : 20u, s.ranges);
+  }
+}